@@ -80,6 +80,7 @@
 #include "cmdutils.h"
 #include "ffmpeg.h"
 #include "ffmpeg_sched.h"
+#include "ffmpeg_trace.h"
 #include "ffmpeg_utils.h"
 
 const char program_name[] = "ffmpeg";
@@ -100,6 +101,7 @@ atomic_uint nb_output_dumped = 0;
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *sched_stats_avio = NULL;
 
 InputFile   **input_files   = NULL;
 int        nb_input_files   = 0;
@@ -335,6 +337,9 @@ static void ffmpeg_cleanup(int ret)
     av_freep(&vstats_filename);
     of_enc_stats_close();
 
+    avio_closep(&sched_stats_avio);
+    trace_close();
+
     hw_device_free_all();
 
     av_freep(&filter_nbthreads);
@@ -796,6 +801,30 @@ static int check_keyboard_interaction(int64_t cur_time)
     return 0;
 }
 
+static void print_sched_stats(Scheduler *sch, int is_last_report)
+{
+    AVBPrint buf;
+    int ret;
+
+    if (!sched_stats_avio)
+        return;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    sch_stats_print(sch, &buf, is_last_report);
+
+    avio_write(sched_stats_avio, buf.str, FFMIN(buf.len, buf.size - 1));
+    avio_flush(sched_stats_avio);
+    av_bprint_finalize(&buf, NULL);
+
+    if (is_last_report) {
+        if ((ret = avio_closep(&sched_stats_avio)) < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing scheduler statistics log, loss of information possible: %s\n",
+                   av_err2str(ret));
+    }
+}
+
 /*
  * The following code is the main loop of the file converter
  */
@@ -828,10 +857,16 @@ static int transcode(Scheduler *sch)
 
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start, cur_time, transcode_ts);
+        print_sched_stats(sch, 0);
     }
 
     ret = sch_stop(sch, &transcode_ts);
 
+    if (sched_stats_avio) {
+        print_sched_stats(sch, 1);
+        sch_stats_log(sch, AV_LOG_INFO);
+    }
+
     /* write the trailer if needed */
     for (int i = 0; i < nb_output_files; i++) {
         int err = of_write_trailer(output_files[i]);
@@ -909,6 +944,13 @@ int main(int argc, char **argv)
 #endif
     avformat_network_init();
 
+#if HAVE_FORK
+    /* with -job_server, this only returns in the processes running the jobs */
+    ret = job_server_run(&argc, &argv);
+    if (ret)
+        return ret < 0 ? 1 : 0;
+#endif
+
     show_banner(argc, argv, options);
 
     sch = sch_alloc();
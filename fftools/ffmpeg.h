@@ -128,6 +128,7 @@ typedef struct OptionsContext {
     int64_t start_time_eof;
     int seek_timestamp;
     const char *format;
+    const char *sched_affinity;
 
     SpecifierOptList codec_names;
     SpecifierOptList audio_ch_layouts;
@@ -217,6 +218,7 @@ typedef struct OptionsContext {
     SpecifierOptList passlogfiles;
     SpecifierOptList max_muxing_queue_size;
     SpecifierOptList muxing_queue_data_threshold;
+    SpecifierOptList latency_budget;
     SpecifierOptList guess_layout_max;
     SpecifierOptList apad;
     SpecifierOptList discard;
@@ -568,6 +570,9 @@ typedef struct OutputStream {
     /* video only */
     AVRational frame_rate;
     AVRational max_frame_rate;
+    // frames arriving at the encoder later than this after they were
+    // demuxed are dropped; 0 to disable
+    int64_t latency_budget;
     int force_fps;
 #if FFMPEG_OPT_TOP
     int top_field_first;
@@ -684,6 +689,7 @@ extern int print_stats;
 extern int64_t stats_period;
 extern int stdin_interaction;
 extern AVIOContext *progress_avio;
+extern AVIOContext *sched_stats_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
@@ -753,6 +759,18 @@ void fg_send_command(FilterGraph *fg, double time, const char *target,
 
 int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch);
 
+/**
+ * Run as a job server if -job_server is present on the command line.
+ *
+ * The server forks a new process for every job it receives. In such a
+ * process, this function returns 0 with argc/argv replaced by the command
+ * line of the job.
+ *
+ * @return 0 to run the command line in argc/argv, 1 when the server was
+ *         stopped, a negative error code on failure
+ */
+int job_server_run(int *argc, char ***argv);
+
 void enc_stats_write(OutputStream *ost, EncStats *es,
                      const AVFrame *frame, const AVPacket *pkt,
                      uint64_t frame_num);
@@ -32,6 +32,7 @@
 #include "libavcodec/codec.h"
 
 #include "ffmpeg.h"
+#include "ffmpeg_trace.h"
 
 typedef struct DecoderPriv {
     Decoder             dec;
@@ -1150,6 +1151,7 @@ static int dec_open(DecoderPriv *dp, AVDictionary **dec_opts,
                     const DecoderOpts *o, AVFrame *param_out)
 {
     const AVCodec *codec = o->codec;
+    int64_t trace_ts;
     int ret;
 
     dp->flags      = o->flags;
@@ -1225,7 +1227,10 @@ static int dec_open(DecoderPriv *dp, AVDictionary **dec_opts,
     dp->apply_cropping          = dp->dec_ctx->apply_cropping;
     dp->dec_ctx->apply_cropping = 0;
 
-    if ((ret = avcodec_open2(dp->dec_ctx, codec, NULL)) < 0) {
+    trace_ts = trace_begin();
+    ret = avcodec_open2(dp->dec_ctx, codec, NULL);
+    trace_end(trace_ts, TRACE_STARTUP, dp, "open decoder");
+    if (ret < 0) {
         av_log(dp, AV_LOG_ERROR, "Error while opening decoder: %s\n",
                av_err2str(ret));
         return ret;
@@ -21,6 +21,7 @@
 
 #include "ffmpeg.h"
 #include "ffmpeg_sched.h"
+#include "ffmpeg_trace.h"
 #include "ffmpeg_utils.h"
 
 #include "libavutil/avassert.h"
@@ -946,8 +947,11 @@ static int ist_use(InputStream *ist, int decoding_needed)
         if (!ds->decoded_params)
             return AVERROR(ENOMEM);
 
+        // the decoder threads are created here and inherit the demuxer's CPUs
+        sch_demux_affinity_enter(d->sch, d->f.index);
         ret = dec_init(&ist->decoder, d->sch,
                        &ds->decoder_opts, &ds->dec_opts, ds->decoded_params);
+        sch_demux_affinity_leave(d->sch, d->f.index);
         if (ret < 0)
             return ret;
         ds->sch_idx_dec = ret;
@@ -1552,7 +1556,7 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     AVFormatContext *ic;
     const AVInputFormat *file_iformat = NULL;
     int err, i, ret = 0;
-    int64_t timestamp;
+    int64_t timestamp, trace_ts;
     AVDictionary *unused_opts = NULL;
     const AVDictionaryEntry *e = NULL;
     const char*    video_codec_name = NULL;
@@ -1577,6 +1581,12 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
         return ret;
     d->sch = sch;
 
+    if (o->sched_affinity) {
+        ret = sch_demux_affinity(sch, ret, o->sched_affinity);
+        if (ret < 0)
+            return ret;
+    }
+
     if (stop_time != INT64_MAX && recording_time != INT64_MAX) {
         stop_time = INT64_MAX;
         av_log(d, AV_LOG_WARNING, "-t and -to cannot be used together; using -t.\n");
@@ -1685,7 +1695,9 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
         scan_all_pmts_set = 1;
     }
     /* open the input file with generic avformat function */
+    trace_ts = trace_begin();
     err = avformat_open_input(&ic, filename, file_iformat, &o->g->format_opts);
+    trace_end(trace_ts, TRACE_STARTUP, d, "open input");
     if (err < 0) {
         av_log(d, AV_LOG_ERROR,
                "Error opening input: %s\n", av_err2str(err));
@@ -1725,7 +1737,9 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
 
         /* If not enough info to get the stream parameters, we decode the
            first frames to get it. (used in mpeg case for example) */
+        trace_ts = trace_begin();
         ret = avformat_find_stream_info(ic, opts);
+        trace_end(trace_ts, TRACE_STARTUP, d, "find stream info");
 
         for (i = 0; i < orig_nb_streams; i++)
             av_dict_free(&opts[i]);
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "ffmpeg_trace.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
@@ -45,6 +46,9 @@ struct Encoder {
     // number of packets received from the encoder
     uint64_t packets_encoded;
 
+    // number of frames dropped for exceeding OutputStream.latency_budget
+    uint64_t frames_dropped_late;
+
     int opened;
     int attach_par;
 
@@ -172,6 +176,7 @@ int enc_open(void *opaque, const AVFrame *frame)
     const AVCodec      *enc = enc_ctx->codec;
     OutputFile          *of = ost->file;
     FrameData *fd;
+    int64_t trace_ts;
     int frame_samples = 0;
     int ret;
 
@@ -325,7 +330,10 @@ int enc_open(void *opaque, const AVFrame *frame)
         return ret;
     }
 
-    if ((ret = avcodec_open2(ost->enc_ctx, enc, &ost->encoder_opts)) < 0) {
+    trace_ts = trace_begin();
+    ret = avcodec_open2(ost->enc_ctx, enc, &ost->encoder_opts);
+    trace_end(trace_ts, TRACE_STARTUP, ost, "open encoder");
+    if (ret < 0) {
         if (ret != AVERROR_EXPERIMENTAL)
             av_log(ost, AV_LOG_ERROR, "Error while opening encoder - maybe "
                    "incorrect parameters such as bit_rate, rate, width or height.\n");
@@ -765,9 +773,13 @@ static enum AVPictureType forced_kf_apply(void *logctx, KeyframeForceCtx *kf,
         goto force_keyframe;
     }
 
+    if (kf->dropped_keyframe)
+        goto force_keyframe;
+
     return AV_PICTURE_TYPE_NONE;
 
 force_keyframe:
+    kf->dropped_keyframe = 0;
     av_log(logctx, AV_LOG_DEBUG, "Forced keyframe at time %f\n", pts_time);
     return AV_PICTURE_TYPE_I;
 }
@@ -848,6 +860,41 @@ fail:
     return AVERROR(ENOMEM);
 }
 
+/**
+ * Check whether a frame has exceeded the stream's latency budget and should
+ * be dropped rather than encoded, to let the encoder catch up with a live
+ * input.
+ */
+static int frame_drop_late(OutputStream *ost, AVFrame *frame)
+{
+    Encoder *e = ost->enc;
+    const FrameData *fd;
+    int64_t demuxed;
+
+    if (!ost->latency_budget || !frame->opaque_ref)
+        return 0;
+
+    fd      = (const FrameData*)frame->opaque_ref->data;
+    demuxed = fd->wallclock[LATENCY_PROBE_DEMUX];
+
+    if (demuxed == INT64_MIN ||
+        av_gettime_relative() - demuxed <= ost->latency_budget)
+        return 0;
+
+    // make the next encoded frame a keyframe instead
+    if (frame->flags & AV_FRAME_FLAG_KEY)
+        ost->kf.dropped_keyframe = 1;
+
+    e->frames_dropped_late++;
+    if (ost->filter)
+        atomic_fetch_add(&ost->filter->nb_frames_drop, 1);
+
+    av_log(ost, AV_LOG_DEBUG, "Dropping late frame with pts %s\n",
+           av_ts2str(frame->pts));
+
+    return 1;
+}
+
 int encoder_thread(void *arg)
 {
     OutputStream *ost = arg;
@@ -896,6 +943,12 @@ int encoder_thread(void *arg)
             name_set = 1;
         }
 
+        // never drop the first frame, it may be needed to set up the encoder
+        if (ost->frames_encoded && frame_drop_late(ost, et.frame)) {
+            av_frame_unref(et.frame);
+            continue;
+        }
+
         ret = frame_encode(ost, et.frame, et.pkt);
 
         av_packet_unref(et.pkt);
@@ -923,6 +976,10 @@ int encoder_thread(void *arg)
     if (ret == AVERROR_EOF)
         ret = 0;
 
+    if (e->frames_dropped_late)
+        av_log(ost, AV_LOG_WARNING, "Dropped %"PRIu64" frames that exceeded "
+               "the latency budget\n", e->frames_dropped_late);
+
 finish:
     enc_thread_uninit(&et);
 
@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "ffmpeg_trace.h"
 
 #include "libavfilter/avfilter.h"
 #include "libavfilter/buffersink.h"
@@ -1849,6 +1850,7 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
     int ret, i, simple = filtergraph_is_simple(fg);
     int have_input_eof = 0;
     const char *graph_desc = fgp->graph_desc;
+    int64_t trace_ts = trace_begin();
 
     cleanup_filtergraph(fg, fgt);
     fgt->graph = avfilter_graph_alloc();
@@ -1981,6 +1983,8 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             goto fail;
     }
 
+    trace_end(trace_ts, TRACE_STARTUP, fg, "configure filtergraph");
+
     return 0;
 fail:
     cleanup_filtergraph(fg, fgt);
@@ -22,6 +22,7 @@
 
 #include "ffmpeg.h"
 #include "ffmpeg_mux.h"
+#include "ffmpeg_trace.h"
 #include "ffmpeg_utils.h"
 #include "sync_queue.h"
 
@@ -227,6 +228,8 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
 
     ms->data_size_mux += pkt->size;
     frame_num = atomic_fetch_add(&ost->packets_written, 1);
+    if (!frame_num)
+        trace_mark(TRACE_STARTUP, ost, "first packet");
 
     pkt->stream_index = ost->index;
 
@@ -558,9 +561,12 @@ int mux_check_init(void *arg)
     Muxer     *mux = arg;
     OutputFile *of = &mux->of;
     AVFormatContext *fc = mux->fc;
+    int64_t trace_ts;
     int ret;
 
+    trace_ts = trace_begin();
     ret = avformat_write_header(fc, &mux->opts);
+    trace_end(trace_ts, TRACE_STARTUP, mux, "write header");
     if (ret < 0) {
         av_log(mux, AV_LOG_ERROR, "Could not write header (incorrect codec "
                "parameters ?): %s\n", av_err2str(ret));
@@ -587,6 +587,7 @@ static int new_stream_video(Muxer *mux, const OptionsContext *o,
     AVFormatContext *oc = mux->fc;
     AVStream *st;
     char *frame_rate = NULL, *max_frame_rate = NULL, *frame_aspect_ratio = NULL;
+    char *latency_budget = NULL;
     int ret = 0;
 
     st  = ost->st;
@@ -619,6 +620,15 @@ static int new_stream_video(Muxer *mux, const OptionsContext *o,
         ost->frame_aspect_ratio = q;
     }
 
+    MATCH_PER_STREAM_OPT(latency_budget, str, latency_budget, oc, st);
+    if (latency_budget) {
+        ret = av_parse_time(&ost->latency_budget, latency_budget, 1);
+        if (ret < 0 || ost->latency_budget <= 0) {
+            av_log(ost, AV_LOG_FATAL, "Invalid latency budget: %s\n", latency_budget);
+            return AVERROR(EINVAL);
+        }
+    }
+
     if (ost->enc_ctx) {
         AVCodecContext *video_enc = ost->enc_ctx;
         const char *p = NULL, *fps_mode = NULL;
@@ -3266,6 +3276,12 @@ int of_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     mux->sch     = sch;
     mux->sch_idx = err;
 
+    if (o->sched_affinity) {
+        err = sch_mux_affinity(sch, mux->sch_idx, o->sched_affinity);
+        if (err < 0)
+            return err;
+    }
+
     /* create all output streams for this file */
     err = create_streams(mux, o);
     if (err < 0)
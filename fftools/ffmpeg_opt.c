@@ -29,6 +29,7 @@
 
 #include "ffmpeg.h"
 #include "ffmpeg_sched.h"
+#include "ffmpeg_trace.h"
 #include "cmdutils.h"
 #include "opt_common.h"
 
@@ -351,6 +352,14 @@ static int opt_stats_period(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+#if HAVE_FORK
+static int opt_job_server(void *optctx, const char *opt, const char *arg)
+{
+    av_log(NULL, AV_LOG_ERROR, "Option '%s' cannot be used in a job\n", opt);
+    return AVERROR(EINVAL);
+}
+#endif
+
 static int opt_audio_codec(void *optctx, const char *opt, const char *arg)
 {
     OptionsContext *o = optctx;
@@ -487,6 +496,36 @@ static int opt_sdp_file(void *optctx, const char *opt, const char *arg)
     return sch_sdp_filename(sch, arg);
 }
 
+static int opt_sched_max_running(void *optctx, const char *opt, const char *arg)
+{
+    Scheduler *sch = optctx;
+    double nb_tasks;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &nb_tasks);
+    if (ret < 0)
+        return ret;
+
+    sch_max_running_tasks(sch, nb_tasks);
+
+    return 0;
+}
+
+static int opt_queue_mem_target(void *optctx, const char *opt, const char *arg)
+{
+    Scheduler *sch = optctx;
+    double max;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT64, 0, FFMIN(INT64_MAX, SIZE_MAX), &max);
+    if (ret < 0)
+        return ret;
+
+    sch_queue_mem_target(sch, max);
+
+    return 0;
+}
+
 #if CONFIG_VAAPI
 static int opt_vaapi_device(void *optctx, const char *opt, const char *arg)
 {
@@ -1302,6 +1341,63 @@ static int opt_progress(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_sched_stats(void *optctx, const char *opt, const char *arg)
+{
+    Scheduler *sch = optctx;
+    AVIOContext *avio = NULL;
+    int ret;
+
+    if (!strcmp(arg, "-"))
+        arg = "pipe:";
+    ret = avio_open2(&avio, arg, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open scheduler statistics URL \"%s\": %s\n",
+               arg, av_err2str(ret));
+        return ret;
+    }
+    avio_closep(&sched_stats_avio);
+    sched_stats_avio = avio;
+
+    sch_enable_stats(sch);
+
+    return 0;
+}
+
+static int opt_startup_report(void *optctx, const char *opt, const char *arg)
+{
+    AVIOContext *avio = NULL;
+    int ret;
+
+    if (!strcmp(arg, "-"))
+        arg = "pipe:";
+    ret = avio_open2(&avio, arg, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open startup report URL \"%s\": %s\n",
+               arg, av_err2str(ret));
+        return ret;
+    }
+
+    return trace_open(avio);
+}
+
+static int opt_startup_report_duration(void *optctx, const char *opt, const char *arg)
+{
+    int64_t duration;
+    int ret = av_parse_time(&duration, arg, 1);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid duration specification for %s: %s\n", opt, arg);
+        return ret;
+    }
+    if (duration <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid %s: %s, must be positive\n", opt, arg);
+        return AVERROR(EINVAL);
+    }
+
+    trace_set_duration(duration);
+
+    return 0;
+}
+
 int opt_timelimit(void *optctx, const char *opt, const char *arg)
 {
 #if HAVE_SETRLIMIT
@@ -1573,6 +1669,28 @@ const OptionDef options[] = {
     { "stats_period",        OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_stats_period },
         "set the period at which ffmpeg updates stats and -progress output", "time" },
+#if HAVE_FORK
+    { "job_server",          OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_job_server },
+        "run jobs received on a UNIX socket, each in a forked process", "path" },
+#endif
+    { "sched_stats",         OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_stats },
+        "write per-task and per-queue scheduling statistics", "url" },
+    { "startup_report",      OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_startup_report },
+        "write a trace of the startup phases and scheduling", "url" },
+    { "startup_report_duration", OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_startup_report_duration },
+        "set the time span recorded by -startup_report", "time" },
+    { "sched_max_running",   OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_max_running },
+        "maximum number of demuxing/decoding/filtering/encoding tasks running at the same time; "
+        "limits running tasks, not threads: every task keeps its own thread", "number" },
+    { "queue_mem_target",    OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_queue_mem_target },
+        "target for the memory used by packets and frames queued between threads; "
+        "not a hard limit", "bytes" },
     { "attach",              OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_PERFILE | OPT_EXPERT | OPT_OUTPUT,
         { .func_arg = opt_attach },
         "add an attachment to the output file", "filename" },
@@ -1596,6 +1714,9 @@ const OptionDef options[] = {
     { "thread_queue_size",   OPT_TYPE_INT,  OPT_OFFSET | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT,
         { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
+    { "sched_affinity",      OPT_TYPE_STRING, OPT_OFFSET | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT,
+        { .off = OFFSET(sched_affinity) },
+        "restrict the threads processing this file to the given CPUs", "cpus" },
     { "find_stream_info",    OPT_TYPE_BOOL, OPT_INPUT | OPT_EXPERT | OPT_OFFSET,
         { .off = OFFSET(find_stream_info) },
         "read and decode the streams to fill missing information with heuristics" },
@@ -1633,6 +1754,9 @@ const OptionDef options[] = {
     { "fpsmax",                     OPT_TYPE_STRING, OPT_VIDEO | OPT_PERSTREAM | OPT_OUTPUT | OPT_EXPERT,
         { .off = OFFSET(max_frame_rates) },
         "set max frame rate (Hz value, fraction or abbreviation)", "rate" },
+    { "latency_budget",             OPT_TYPE_STRING, OPT_VIDEO | OPT_PERSTREAM | OPT_OUTPUT | OPT_EXPERT,
+        { .off = OFFSET(latency_budget) },
+        "drop frames reaching the encoder later than this after being demuxed", "time" },
     { "s",                          OPT_TYPE_STRING, OPT_VIDEO | OPT_SUBTITLE | OPT_PERSTREAM | OPT_INPUT | OPT_OUTPUT,
         { .off = OFFSET(frame_sizes) },
         "set frame size (WxH or abbreviation)", "size" },
@@ -19,12 +19,22 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+
+#if HAVE_SCHED_SETAFFINITY
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
 #include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include "cmdutils.h"
 #include "ffmpeg_sched.h"
+#include "ffmpeg_trace.h"
 #include "ffmpeg_utils.h"
 #include "sync_queue.h"
 #include "thread_queue.h"
@@ -32,6 +42,7 @@
 #include "libavcodec/packet.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
@@ -44,11 +55,19 @@
 // FIXME: some other value? make this dynamic?
 #define SCHEDULE_TOLERANCE (100 * 1000)
 
+// maximum length packet queues may grow to with -queue_mem_target
+#define ADAPTIVE_PACKET_THREAD_QUEUE_SIZE 1024
+
 enum QueueType {
     QUEUE_PACKETS,
     QUEUE_FRAMES,
 };
 
+enum SchWaitType {
+    SCH_WAIT_INPUT,
+    SCH_WAIT_OUTPUT,
+};
+
 typedef struct SchWaiter {
     pthread_mutex_t     lock;
     pthread_cond_t      cond;
@@ -69,6 +88,38 @@ typedef struct SchTask {
 
     pthread_t           thread;
     int                 thread_running;
+
+    // list of CPUs the task's thread is restricted to, NULL for no restriction
+    char               *affinity;
+#if HAVE_SCHED_SETAFFINITY
+    // restriction of the thread that called task_affinity_enter(), restored
+    // by task_affinity_leave()
+    cpu_set_t           affinity_saved;
+    int                 affinity_entered;
+#endif
+
+    // the following are only accessed from the task's own thread
+    // this task holds one of Scheduler.task_slots_free
+    int                 has_slot;
+    // state of the current task_wait_begin() call
+    int                 wait_slot;
+    int64_t             wait_trace_ts;
+
+    // statistics, only collected when Scheduler.stats is set; times are
+    // in microseconds as returned by av_gettime_relative()
+    atomic_int_least64_t time_start;
+    atomic_int_least64_t time_end;
+    // time spent waiting for input
+    atomic_int_least64_t time_idle;
+    // time spent waiting for downstream to accept output
+    atomic_int_least64_t time_blocked;
+    // start time and type of the current wait, 0 when not waiting
+    atomic_int_least64_t wait_start;
+    atomic_int           wait_type;
+    // odd while the task thread is updating wait_start, wait_type and the
+    // accumulated wait times, so that task_stats_get() can read them
+    // consistently
+    atomic_uint          wait_seq;
 } SchTask;
 
 typedef struct SchDec {
@@ -305,6 +356,21 @@ struct Scheduler {
     pthread_mutex_t     schedule_lock;
 
     atomic_int_least64_t last_dts;
+
+    /* Maximum number of tasks that may be running (i.e. not blocked inside
+     * the scheduler) at the same time, 0 for no limit. */
+    unsigned            nb_task_slots;
+    atomic_int          task_slots_free;
+    // the lock and the condition are only used by tasks waiting for a slot
+    atomic_int          task_slot_waiters;
+    pthread_mutex_t     task_slot_lock;
+    pthread_cond_t      task_slot_cond;
+
+    // collect task and queue statistics
+    int                 stats;
+
+    // memory target for all the thread queues, active when max is non-zero
+    TQMemLimit          queue_mem;
 };
 
 /**
@@ -365,11 +431,31 @@ static void waiter_uninit(SchWaiter *w)
     pthread_cond_destroy(&w->cond);
 }
 
-static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_size,
-                       enum QueueType type)
+static size_t pkt_size(void *obj)
+{
+    const AVPacket *pkt = obj;
+    return pkt->buf ? pkt->buf->size : pkt->size;
+}
+
+static size_t frame_size(void *obj)
+{
+    const AVFrame *frame = obj;
+    size_t size = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+        size += frame->buf[i]->size;
+    for (int i = 0; i < frame->nb_extended_buf; i++)
+        size += frame->extended_buf[i]->size;
+
+    return size;
+}
+
+static int queue_alloc(Scheduler *sch, ThreadQueue **ptq, unsigned nb_streams,
+                       unsigned queue_size, enum QueueType type, unsigned flags)
 {
     ThreadQueue *tq;
     ObjPool *op;
+    size_t min_items = 0;
 
     if (queue_size <= 0) {
         if (type == QUEUE_FRAMES)
@@ -392,19 +478,297 @@ static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_si
     if (!op)
         return AVERROR(ENOMEM);
 
+    if (sch->stats)
+        flags |= THREAD_QUEUE_FLAG_STATS;
+
+    // With a memory budget, packet queues may grow beyond their nominal size
+    // to absorb bursts, and always accept their nominal size. Frame queues
+    // may shrink down to a single frame when the frames are large, but never
+    // grow, since decoders size their frame pools based on the nominal size.
+    // Either way, a queue always accepts min_items, so that the budget cannot
+    // deadlock the graph, which makes it a target rather than a hard limit.
+    if (sch->queue_mem.max) {
+        min_items  = (type == QUEUE_PACKETS) ? queue_size : 1;
+        queue_size = (type == QUEUE_PACKETS)                               ?
+                     FFMAX(queue_size, ADAPTIVE_PACKET_THREAD_QUEUE_SIZE) :
+                     queue_size;
+    }
+
     tq = tq_alloc(nb_streams, queue_size, op,
-                  (type == QUEUE_PACKETS) ? pkt_move : frame_move);
+                  (type == QUEUE_PACKETS) ? pkt_move : frame_move, flags);
     if (!tq) {
         objpool_free(&op);
         return AVERROR(ENOMEM);
     }
 
+    if (min_items) {
+        int ret = tq_set_mem_limit(tq, &sch->queue_mem, min_items,
+                                   (type == QUEUE_PACKETS) ? pkt_size : frame_size);
+        if (ret < 0) {
+            tq_free(&tq);
+            return ret;
+        }
+    }
+
     *ptq = tq;
     return 0;
 }
 
 static void *task_wrapper(void *arg);
 
+static int task_limited(const SchTask *task)
+{
+    // muxers spend their time in I/O and cannot delay other tasks'
+    // progress by waiting for a slot, so they are not counted
+    return task->parent->nb_task_slots && task->node.type != SCH_NODE_TYPE_MUX;
+}
+
+static int slot_try_acquire(Scheduler *sch)
+{
+    int nb_free = atomic_load(&sch->task_slots_free);
+
+    while (nb_free > 0) {
+        if (atomic_compare_exchange_weak(&sch->task_slots_free, &nb_free, nb_free - 1))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Slots are taken and given back on every call into the scheduler, so that
+ * is done without the lock unless a task has to wait. A waiting task is
+ * counted in task_slot_waiters before checking for a free slot again, so a
+ * concurrent slot_release() either gives it the slot or wakes it up. */
+static void slot_acquire(Scheduler *sch)
+{
+    if (slot_try_acquire(sch))
+        return;
+
+    pthread_mutex_lock(&sch->task_slot_lock);
+    atomic_fetch_add(&sch->task_slot_waiters, 1);
+
+    while (!slot_try_acquire(sch))
+        pthread_cond_wait(&sch->task_slot_cond, &sch->task_slot_lock);
+
+    atomic_fetch_sub(&sch->task_slot_waiters, 1);
+    pthread_mutex_unlock(&sch->task_slot_lock);
+}
+
+static void slot_release(Scheduler *sch)
+{
+    atomic_fetch_add(&sch->task_slots_free, 1);
+
+    if (!atomic_load(&sch->task_slot_waiters))
+        return;
+
+    pthread_mutex_lock(&sch->task_slot_lock);
+    pthread_cond_signal(&sch->task_slot_cond);
+    pthread_mutex_unlock(&sch->task_slot_lock);
+}
+
+static void task_slot_acquire(Scheduler *sch, SchTask *task)
+{
+    if (!task_limited(task))
+        return;
+
+    slot_acquire(sch);
+
+    task->has_slot = 1;
+}
+
+/**
+ * Give up the task's slot before doing anything that might block.
+ *
+ * @return 1 if a slot was released and should be reacquired with
+ *         task_slot_acquire(), 0 otherwise
+ */
+static int task_slot_release(Scheduler *sch, SchTask *task)
+{
+    if (!task->has_slot)
+        return 0;
+
+    slot_release(sch);
+
+    task->has_slot = 0;
+
+    return 1;
+}
+
+/**
+ * Called by a task before doing something that might block,
+ * must be followed by task_wait_end().
+ */
+static void task_wait_begin(Scheduler *sch, SchTask *task, enum SchWaitType type)
+{
+    if (sch->stats) {
+        atomic_fetch_add(&task->wait_seq, 1);
+        atomic_store(&task->wait_type, type);
+        atomic_store(&task->wait_start, av_gettime_relative());
+        atomic_fetch_add(&task->wait_seq, 1);
+    } else
+        atomic_store(&task->wait_type, type);
+
+    task->wait_trace_ts = trace_begin();
+
+    task->wait_slot = task_slot_release(sch, task);
+}
+
+static void task_wait_end(Scheduler *sch, SchTask *task)
+{
+    if (task->wait_slot)
+        task_slot_acquire(sch, task);
+
+    trace_end(task->wait_trace_ts, TRACE_SCHED, task->func_arg,
+              atomic_load(&task->wait_type) == SCH_WAIT_INPUT ?
+              "wait input" : "wait output");
+
+    if (sch->stats) {
+        atomic_int_least64_t *dst = atomic_load(&task->wait_type) == SCH_WAIT_INPUT ?
+                                    &task->time_idle : &task->time_blocked;
+        int64_t now = av_gettime_relative();
+
+        atomic_fetch_add(&task->wait_seq, 1);
+        atomic_fetch_add(dst, now - atomic_load(&task->wait_start));
+        atomic_store(&task->wait_start, 0);
+        atomic_fetch_add(&task->wait_seq, 1);
+    }
+}
+
+#if HAVE_SCHED_SETAFFINITY
+static int parse_cpu_list(const char *str, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+
+    while (*str) {
+        unsigned long first, last;
+        char *next;
+
+        first = strtoul(str, &next, 10);
+        if (next == str)
+            return AVERROR(EINVAL);
+        last = first;
+
+        if (*next == '-') {
+            str  = next + 1;
+            last = strtoul(str, &next, 10);
+            if (next == str || last < first)
+                return AVERROR(EINVAL);
+        }
+        if (last >= CPU_SETSIZE)
+            return AVERROR(EINVAL);
+
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+
+        if (*next == ',')
+            next++;
+        else if (*next)
+            return AVERROR(EINVAL);
+        str = next;
+    }
+
+    return CPU_COUNT(set) ? 0 : AVERROR(EINVAL);
+}
+#endif
+
+static int task_set_affinity(SchTask *task, const char *cpus)
+{
+#if HAVE_SCHED_SETAFFINITY
+    cpu_set_t set;
+    int ret;
+
+    ret = parse_cpu_list(cpus, &set);
+    if (ret < 0) {
+        av_log(task->func_arg, AV_LOG_ERROR, "Invalid CPU list: %s\n", cpus);
+        return ret;
+    }
+
+    av_freep(&task->affinity);
+    task->affinity = av_strdup(cpus);
+    if (!task->affinity)
+        return AVERROR(ENOMEM);
+
+    return 0;
+#else
+    av_log(task->func_arg, AV_LOG_ERROR,
+           "Setting thread affinity is not supported on this platform\n");
+    return AVERROR(ENOSYS);
+#endif
+}
+
+// called from the task's own thread
+static void task_apply_affinity(SchTask *task)
+{
+#if HAVE_SCHED_SETAFFINITY
+    cpu_set_t set;
+
+    if (!task->affinity)
+        return;
+
+    // the list was validated in task_set_affinity()
+    parse_cpu_list(task->affinity, &set);
+
+    // on Linux, pid 0 refers to the calling thread
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        av_log(task->func_arg, AV_LOG_WARNING,
+               "Could not restrict thread to CPUs %s: %s\n",
+               task->affinity, av_err2str(AVERROR(errno)));
+    else
+        av_log(task->func_arg, AV_LOG_VERBOSE,
+               "Thread restricted to CPUs %s\n", task->affinity);
+#endif
+}
+
+/*
+ * Codecs are opened on other threads than the task's own (decoders on the
+ * main thread, encoders on the thread sending them their first frame), and
+ * their worker threads are created there. Temporarily restrict the calling
+ * thread to the task's CPUs, so that those inherit the restriction.
+ */
+static void task_affinity_enter(SchTask *task)
+{
+#if HAVE_SCHED_SETAFFINITY
+    cpu_set_t set;
+
+    av_assert0(!task->affinity_entered);
+
+    if (!task->affinity)
+        return;
+
+    if (sched_getaffinity(0, sizeof(task->affinity_saved), &task->affinity_saved) < 0) {
+        av_log(task->func_arg, AV_LOG_WARNING,
+               "Could not get the CPUs of the current thread: %s\n",
+               av_err2str(AVERROR(errno)));
+        return;
+    }
+
+    parse_cpu_list(task->affinity, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        av_log(task->func_arg, AV_LOG_WARNING,
+               "Could not restrict codec threads to CPUs %s: %s\n",
+               task->affinity, av_err2str(AVERROR(errno)));
+        return;
+    }
+
+    task->affinity_entered = 1;
+#endif
+}
+
+static void task_affinity_leave(SchTask *task)
+{
+#if HAVE_SCHED_SETAFFINITY
+    if (!task->affinity_entered)
+        return;
+
+    if (sched_setaffinity(0, sizeof(task->affinity_saved), &task->affinity_saved) < 0)
+        av_log(task->func_arg, AV_LOG_WARNING,
+               "Could not restore the CPUs of the current thread: %s\n",
+               av_err2str(AVERROR(errno)));
+
+    task->affinity_entered = 0;
+#endif
+}
+
 static int task_start(SchTask *task)
 {
     int ret;
@@ -434,6 +798,14 @@ static void task_init(Scheduler *sch, SchTask *task, enum SchedulerNodeType type
 
     task->func      = func;
     task->func_arg  = func_arg;
+
+    atomic_init(&task->time_start,   0);
+    atomic_init(&task->time_end,     0);
+    atomic_init(&task->time_idle,    0);
+    atomic_init(&task->time_blocked, 0);
+    atomic_init(&task->wait_start,   0);
+    atomic_init(&task->wait_type,    0);
+    atomic_init(&task->wait_seq,     0);
 }
 
 static int64_t trailing_dts(const Scheduler *sch, int count_finished)
@@ -480,6 +852,8 @@ void sch_free(Scheduler **psch)
         av_packet_free(&d->send_pkt);
 
         waiter_uninit(&d->waiter);
+
+        av_freep(&d->task.affinity);
     }
     av_freep(&sch->demux);
 
@@ -503,6 +877,8 @@ void sch_free(Scheduler **psch)
         av_packet_free(&mux->sub_heartbeat_pkt);
 
         tq_free(&mux->queue);
+
+        av_freep(&mux->task.affinity);
     }
     av_freep(&sch->mux);
 
@@ -517,6 +893,8 @@ void sch_free(Scheduler **psch)
         av_freep(&dec->dst_finished);
 
         av_frame_free(&dec->send_frame);
+
+        av_freep(&dec->task.affinity);
     }
     av_freep(&sch->dec);
 
@@ -529,6 +907,8 @@ void sch_free(Scheduler **psch)
 
         av_freep(&enc->dst);
         av_freep(&enc->dst_finished);
+
+        av_freep(&enc->task.affinity);
     }
     av_freep(&sch->enc);
 
@@ -550,6 +930,8 @@ void sch_free(Scheduler **psch)
         av_freep(&fg->outputs);
 
         waiter_uninit(&fg->waiter);
+
+        av_freep(&fg->task.affinity);
     }
     av_freep(&sch->filters);
 
@@ -562,6 +944,11 @@ void sch_free(Scheduler **psch)
     pthread_mutex_destroy(&sch->mux_done_lock);
     pthread_cond_destroy(&sch->mux_done_cond);
 
+    pthread_mutex_destroy(&sch->task_slot_lock);
+    pthread_cond_destroy(&sch->task_slot_cond);
+
+    tq_mem_limit_uninit(&sch->queue_mem);
+
     av_freep(psch);
 }
 
@@ -582,6 +969,13 @@ Scheduler *sch_alloc(void)
     sch->class    = &scheduler_class;
     sch->sdp_auto = 1;
 
+    atomic_init(&sch->task_slots_free,   0);
+    atomic_init(&sch->task_slot_waiters, 0);
+
+    ret = tq_mem_limit_init(&sch->queue_mem, 0);
+    if (ret < 0)
+        goto fail;
+
     ret = pthread_mutex_init(&sch->schedule_lock, NULL);
     if (ret)
         goto fail;
@@ -598,12 +992,40 @@ Scheduler *sch_alloc(void)
     if (ret)
         goto fail;
 
+    ret = pthread_mutex_init(&sch->task_slot_lock, NULL);
+    if (ret)
+        goto fail;
+
+    ret = pthread_cond_init(&sch->task_slot_cond, NULL);
+    if (ret)
+        goto fail;
+
     return sch;
 fail:
     sch_free(&sch);
     return NULL;
 }
 
+void sch_max_running_tasks(Scheduler *sch, unsigned nb_tasks)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    sch->nb_task_slots = nb_tasks;
+    atomic_store(&sch->task_slots_free, nb_tasks);
+}
+
+void sch_queue_mem_target(Scheduler *sch, size_t max)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->queue_mem.max = max;
+}
+
+void sch_enable_stats(Scheduler *sch)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->stats = 1;
+}
+
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename)
 {
     av_freep(&sch->sdp_filename);
@@ -641,6 +1063,12 @@ int sch_add_mux(Scheduler *sch, SchThreadFunc func, int (*init)(void *),
     return idx;
 }
 
+int sch_mux_affinity(Scheduler *sch, unsigned mux_idx, const char *cpus)
+{
+    av_assert0(mux_idx < sch->nb_mux);
+    return task_set_affinity(&sch->mux[mux_idx].task, cpus);
+}
+
 int sch_add_mux_stream(Scheduler *sch, unsigned mux_idx)
 {
     SchMux       *mux;
@@ -700,6 +1128,24 @@ int sch_add_demux(Scheduler *sch, SchThreadFunc func, void *ctx)
     return idx;
 }
 
+int sch_demux_affinity(Scheduler *sch, unsigned demux_idx, const char *cpus)
+{
+    av_assert0(demux_idx < sch->nb_demux);
+    return task_set_affinity(&sch->demux[demux_idx].task, cpus);
+}
+
+void sch_demux_affinity_enter(Scheduler *sch, unsigned demux_idx)
+{
+    av_assert0(demux_idx < sch->nb_demux);
+    task_affinity_enter(&sch->demux[demux_idx].task);
+}
+
+void sch_demux_affinity_leave(Scheduler *sch, unsigned demux_idx)
+{
+    av_assert0(demux_idx < sch->nb_demux);
+    task_affinity_leave(&sch->demux[demux_idx].task);
+}
+
 int sch_add_demux_stream(Scheduler *sch, unsigned demux_idx)
 {
     SchDemux *d;
@@ -739,10 +1185,6 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx,
     if (!dec->send_frame)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS);
-    if (ret < 0)
-        return ret;
-
     if (send_end_ts) {
         ret = av_thread_message_queue_alloc(&dec->queue_end_ts, 1, sizeof(Timestamp));
         if (ret < 0)
@@ -783,10 +1225,6 @@ int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
     if (!enc->send_pkt)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES);
-    if (ret < 0)
-        return ret;
-
     return idx;
 }
 
@@ -831,10 +1269,6 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
-    if (ret < 0)
-        return ret;
-
     return idx;
 }
 
@@ -1387,10 +1821,107 @@ fail:
     return ret;
 }
 
+static int dec_has_heartbeat(const Scheduler *sch, unsigned dec_idx)
+{
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        const SchMux *mux = &sch->mux[i];
+
+        for (unsigned j = 0; j < mux->nb_streams; j++) {
+            const SchMuxStream *ms = &mux->streams[j];
+
+            for (unsigned k = 0; k < ms->nb_sub_heartbeat_dst; k++)
+                if (ms->sub_heartbeat_dst[k] == dec_idx)
+                    return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int affinity_inherit(SchTask *task, const SchTask *src)
+{
+    if (task->affinity || !src->affinity)
+        return 0;
+
+    task->affinity = av_strdup(src->affinity);
+    return task->affinity ? 0 : AVERROR(ENOMEM);
+}
+
+/**
+ * Decoders run on the CPUs of the demuxer they read from, encoders on those
+ * of the (first) muxer they feed, and filtergraphs on those of their
+ * encoders, if they all agree. This keeps each input's and each output's
+ * processing chain and its buffers together.
+ */
+static int affinity_propagate(Scheduler *sch)
+{
+    int ret;
+
+    for (unsigned i = 0; i < sch->nb_dec; i++) {
+        SchDec *dec = &sch->dec[i];
+
+        if (dec->src.type != SCH_NODE_TYPE_DEMUX)
+            continue;
+
+        ret = affinity_inherit(&dec->task, &sch->demux[dec->src.idx].task);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (unsigned i = 0; i < sch->nb_enc; i++) {
+        SchEnc *enc = &sch->enc[i];
+
+        for (unsigned j = 0; j < enc->nb_dst; j++) {
+            if (enc->dst[j].type != SCH_NODE_TYPE_MUX)
+                continue;
+
+            ret = affinity_inherit(&enc->task, &sch->mux[enc->dst[j].idx].task);
+            if (ret < 0)
+                return ret;
+            break;
+        }
+    }
+
+    for (unsigned i = 0; i < sch->nb_filters; i++) {
+        SchFilterGraph *fg = &sch->filters[i];
+        const SchTask  *src = NULL;
+
+        for (unsigned j = 0; j < fg->nb_outputs; j++) {
+            const SchedulerNode dst = fg->outputs[j].dst;
+            const SchTask *enc_task;
+
+            if (dst.type != SCH_NODE_TYPE_ENC) {
+                src = NULL;
+                break;
+            }
+
+            enc_task = &sch->enc[dst.idx].task;
+            if (!enc_task->affinity ||
+                (src && strcmp(src->affinity, enc_task->affinity))) {
+                src = NULL;
+                break;
+            }
+            src = enc_task;
+        }
+
+        if (src) {
+            ret = affinity_inherit(&fg->task, src);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
 static int start_prepare(Scheduler *sch)
 {
     int ret;
 
+    ret = affinity_propagate(sch);
+    if (ret < 0)
+        return ret;
+
     for (unsigned i = 0; i < sch->nb_demux; i++) {
         SchDemux *d = &sch->demux[i];
 
@@ -1426,6 +1957,13 @@ static int start_prepare(Scheduler *sch)
         dec->dst_finished = av_calloc(dec->nb_dst, sizeof(*dec->dst_finished));
         if (!dec->dst_finished)
             return AVERROR(ENOMEM);
+
+        // packets normally arrive only from our source's thread, unless
+        // some muxer also sends subtitle heartbeats to this decoder
+        ret = queue_alloc(sch, &dec->queue, 1, 0, QUEUE_PACKETS,
+                          dec_has_heartbeat(sch, i) ? 0 : THREAD_QUEUE_FLAG_SPSC);
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_enc; i++) {
@@ -1445,6 +1983,13 @@ static int start_prepare(Scheduler *sch)
         enc->dst_finished = av_calloc(enc->nb_dst, sizeof(*enc->dst_finished));
         if (!enc->dst_finished)
             return AVERROR(ENOMEM);
+
+        // frames are sent either by our source's thread, or with the sync
+        // queue lock held, so there is effectively a single sender
+        ret = queue_alloc(sch, &enc->queue, 1, 0, QUEUE_FRAMES,
+                          THREAD_QUEUE_FLAG_SPSC);
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_mux; i++) {
@@ -1475,8 +2020,11 @@ static int start_prepare(Scheduler *sch)
             }
         }
 
-        ret = queue_alloc(&mux->queue, mux->nb_streams, mux->queue_size,
-                          QUEUE_PACKETS);
+        // with a single stream, packets come either from its source or from
+        // flushing the pre-muxing queue, which are serialized
+        ret = queue_alloc(sch, &mux->queue, mux->nb_streams, mux->queue_size,
+                          QUEUE_PACKETS,
+                          mux->nb_streams == 1 ? THREAD_QUEUE_FLAG_SPSC : 0);
         if (ret < 0)
             return ret;
     }
@@ -1517,6 +2065,10 @@ static int start_prepare(Scheduler *sch)
                 return AVERROR(EINVAL);
             }
         }
+
+        ret = queue_alloc(sch, &fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES, 0);
+        if (ret < 0)
+            return ret;
     }
 
     // Check that the transcoding graph has no cycles.
@@ -1624,7 +2176,9 @@ static int enc_open(Scheduler *sch, SchEnc *enc, const AVFrame *frame)
 {
     int ret;
 
+    task_affinity_enter(&enc->task);
     ret = enc->open_cb(enc->task.func_arg, frame);
+    task_affinity_leave(&enc->task);
     if (ret < 0)
         return ret;
 
@@ -1744,7 +2298,16 @@ finish:
 static int send_to_enc(Scheduler *sch, SchEnc *enc, AVFrame *frame)
 {
     if (enc->open_cb && frame && !enc->opened) {
-        int ret = enc_open(sch, enc, frame);
+        int ret;
+
+        // Opening the encoder is done by the sending task, which gave up its
+        // running slot when calling into the scheduler. Take one for it, as
+        // this can be a large amount of work.
+        if (sch->nb_task_slots)
+            slot_acquire(sch);
+        ret = enc_open(sch, enc, frame);
+        if (sch->nb_task_slots)
+            slot_release(sch);
         if (ret < 0)
             return ret;
         enc->opened = 1;
@@ -1967,8 +2530,8 @@ static int demux_flush(Scheduler *sch, SchDemux *d, AVPacket *pkt)
     return 0;
 }
 
-int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
-                   unsigned flags)
+static int demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                      unsigned flags)
 {
     SchDemux *d;
     int terminate;
@@ -1989,6 +2552,22 @@ int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
     return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
 }
 
+int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                   unsigned flags)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(demux_idx < sch->nb_demux);
+    task = &sch->demux[demux_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_OUTPUT);
+    ret = demux_send(sch, demux_idx, pkt, flags);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 static int demux_done(Scheduler *sch, unsigned demux_idx)
 {
     SchDemux *d = &sch->demux[demux_idx];
@@ -2019,7 +2598,10 @@ int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
     av_assert0(mux_idx < sch->nb_mux);
     mux = &sch->mux[mux_idx];
 
+    task_wait_begin(sch, &mux->task, SCH_WAIT_INPUT);
     ret = tq_receive(mux->queue, &stream_idx, pkt);
+    task_wait_end(sch, &mux->task);
+
     pkt->stream_index = stream_idx;
     return ret;
 }
@@ -2095,7 +2677,7 @@ static int mux_done(Scheduler *sch, unsigned mux_idx)
     return 0;
 }
 
-int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
+static int dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
 {
     SchDec *dec;
     int ret, dummy;
@@ -2124,6 +2706,21 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
     return ret;
 }
 
+int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    task = &sch->dec[dec_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_INPUT);
+    ret = dec_receive(sch, dec_idx, pkt);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 static int send_to_filter(Scheduler *sch, SchFilterGraph *fg,
                           unsigned in_idx, AVFrame *frame)
 {
@@ -2171,21 +2768,36 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_dec_send(Scheduler *sch, unsigned dec_idx, AVFrame *frame)
+static int dec_send(Scheduler *sch, unsigned dec_idx, AVFrame *frame)
 {
     SchDec *dec;
     int ret = 0;
     unsigned nb_done = 0;
+    int last = -1;
 
     av_assert0(dec_idx < sch->nb_dec);
     dec = &sch->dec[dec_idx];
 
+    // the last destination that still accepts frames gets the frame itself,
+    // so no references are made for a single live destination and none are
+    // wasted on destinations that are already finished
+    for (int i = dec->nb_dst - 1; i >= 0; i--)
+        if (!dec->dst_finished[i]) {
+            last = i;
+            break;
+        }
+
     for (unsigned i = 0; i < dec->nb_dst; i++) {
         uint8_t *finished = &dec->dst_finished[i];
         AVFrame *to_send  = frame;
 
+        if (*finished) {
+            nb_done++;
+            continue;
+        }
+
         // sending a frame consumes it, so make a temporary reference if needed
-        if (i < dec->nb_dst - 1) {
+        if ((int)i < last) {
             to_send = dec->send_frame;
 
             // frame may sometimes contain props only,
@@ -2208,9 +2820,27 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx, AVFrame *frame)
         }
     }
 
+    if (last < 0)
+        av_frame_unref(frame);
+
     return (nb_done == dec->nb_dst) ? AVERROR_EOF : 0;
 }
 
+int sch_dec_send(Scheduler *sch, unsigned dec_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    task = &sch->dec[dec_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_OUTPUT);
+    ret = dec_send(sch, dec_idx, frame);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 static int dec_done(Scheduler *sch, unsigned dec_idx)
 {
     SchDec *dec = &sch->dec[dec_idx];
@@ -2232,7 +2862,7 @@ static int dec_done(Scheduler *sch, unsigned dec_idx)
     return ret;
 }
 
-int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
+static int enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
 {
     SchEnc *enc;
     int ret, dummy;
@@ -2246,6 +2876,21 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
     return ret;
 }
 
+int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    task = &sch->enc[enc_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_INPUT);
+    ret = enc_receive(sch, enc_idx, frame);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 static int enc_send_to_dst(Scheduler *sch, const SchedulerNode dst,
                            uint8_t *dst_finished, AVPacket *pkt)
 {
@@ -2276,7 +2921,7 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+static int enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
 {
     SchEnc *enc;
     int ret;
@@ -2309,6 +2954,21 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     return 0;
 }
 
+int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    task = &sch->enc[enc_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_OUTPUT);
+    ret = enc_send(sch, enc_idx, pkt);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 static int enc_done(Scheduler *sch, unsigned enc_idx)
 {
     SchEnc *enc = &sch->enc[enc_idx];
@@ -2325,8 +2985,8 @@ static int enc_done(Scheduler *sch, unsigned enc_idx)
     return ret;
 }
 
-int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
-                       unsigned *in_idx, AVFrame *frame)
+static int filter_receive(Scheduler *sch, unsigned fg_idx,
+                          unsigned *in_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
 
@@ -2369,6 +3029,22 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     }
 }
 
+int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
+                       unsigned *in_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    task = &sch->filters[fg_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_INPUT);
+    ret = filter_receive(sch, fg_idx, in_idx, frame);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 {
     SchFilterGraph *fg;
@@ -2390,7 +3066,7 @@ void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
     }
 }
 
-int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
+static int filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
     SchedulerNode  dst;
@@ -2406,6 +3082,21 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
            send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
 }
 
+int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    task = &sch->filters[fg_idx].task;
+
+    task_wait_begin(sch, task, SCH_WAIT_OUTPUT);
+    ret = filter_send(sch, fg_idx, out_idx, frame);
+    task_wait_end(sch, task);
+
+    return ret;
+}
+
 static int filter_done(Scheduler *sch, unsigned fg_idx)
 {
     SchFilterGraph *fg = &sch->filters[fg_idx];
@@ -2464,11 +3155,25 @@ static void *task_wrapper(void *arg)
     int ret;
     int err = 0;
 
+    if (sch->stats)
+        atomic_store(&task->time_start, av_gettime_relative());
+
+    // before the task allocates anything, so that its memory is placed
+    // close to the CPUs it runs on
+    task_apply_affinity(task);
+
+    task_slot_acquire(sch, task);
+
     ret = task->func(task->func_arg);
     if (ret < 0)
         av_log(task->func_arg, AV_LOG_ERROR,
                "Task finished with error code: %d (%s)\n", ret, av_err2str(ret));
 
+    task_slot_release(sch, task);
+
+    if (sch->stats)
+        atomic_store(&task->time_end, av_gettime_relative());
+
     err = task_cleanup(sch, task->node);
     ret = err_merge(ret, err);
 
@@ -2558,3 +3263,190 @@ int sch_stop(Scheduler *sch, int64_t *finish_ts)
 
     return ret;
 }
+
+typedef struct TaskStats {
+    int64_t time_busy;
+    int64_t time_idle;
+    int64_t time_blocked;
+} TaskStats;
+
+/**
+ * @return 0 if the task has not started yet, 1 otherwise
+ */
+static int task_stats_get(const SchTask *task, int64_t now, TaskStats *ts)
+{
+    int64_t start      = atomic_load(&task->time_start);
+    int64_t end        = atomic_load(&task->time_end);
+    int64_t wait_start;
+    int     wait_type;
+    unsigned seq;
+
+    if (!start)
+        return 0;
+
+    // the task thread only holds wait_seq odd for a few instructions, retry
+    // until the wait state and the accumulated times were read in between
+    // two of its updates, so that a wait that just ended is not counted twice
+    do {
+        while ((seq = atomic_load(&task->wait_seq)) & 1)
+            ;
+
+        wait_start       = atomic_load(&task->wait_start);
+        wait_type        = atomic_load(&task->wait_type);
+        ts->time_idle    = atomic_load(&task->time_idle);
+        ts->time_blocked = atomic_load(&task->time_blocked);
+    } while (atomic_load(&task->wait_seq) != seq);
+
+    // account for the wait in progress
+    if (wait_start && !end) {
+        if (wait_type == SCH_WAIT_INPUT)
+            ts->time_idle    += FFMAX(now - wait_start, 0);
+        else
+            ts->time_blocked += FFMAX(now - wait_start, 0);
+    }
+
+    ts->time_busy    = FFMAX((end ? end : now) - start - ts->time_idle - ts->time_blocked, 0);
+
+    return 1;
+}
+
+static const char *node_type_name(enum SchedulerNodeType type)
+{
+    switch (type) {
+    case SCH_NODE_TYPE_DEMUX:     return "demux";
+    case SCH_NODE_TYPE_MUX:       return "mux";
+    case SCH_NODE_TYPE_DEC:       return "dec";
+    case SCH_NODE_TYPE_ENC:       return "enc";
+    case SCH_NODE_TYPE_FILTER_IN: return "filter";
+    default:                      return "unknown";
+    }
+}
+
+// the queue the task receives its input from
+static ThreadQueue *task_queue(const Scheduler *sch, const SchTask *task)
+{
+    const SchedulerNode *node = &task->node;
+
+    switch (node->type) {
+    case SCH_NODE_TYPE_MUX:       return sch->mux[node->idx].queue;
+    case SCH_NODE_TYPE_DEC:       return sch->dec[node->idx].queue;
+    case SCH_NODE_TYPE_ENC:       return sch->enc[node->idx].queue;
+    case SCH_NODE_TYPE_FILTER_IN: return sch->filters[node->idx].queue;
+    default:                      return NULL;
+    }
+}
+
+static const SchTask *task_get(const Scheduler *sch, unsigned idx)
+{
+    if (idx < sch->nb_demux)
+        return &sch->demux[idx].task;
+    idx -= sch->nb_demux;
+    if (idx < sch->nb_dec)
+        return &sch->dec[idx].task;
+    idx -= sch->nb_dec;
+    if (idx < sch->nb_filters)
+        return &sch->filters[idx].task;
+    idx -= sch->nb_filters;
+    if (idx < sch->nb_enc)
+        return &sch->enc[idx].task;
+    idx -= sch->nb_enc;
+    if (idx < sch->nb_mux)
+        return &sch->mux[idx].task;
+
+    return NULL;
+}
+
+// upper bound of the histogram bucket containing the median latency
+static int64_t latency_median(const ThreadQueueStats *qs)
+{
+    uint64_t count = 0;
+
+    for (int i = 0; i < TQ_LATENCY_BUCKETS; i++) {
+        count += qs->latency[i];
+        if (count > qs->nb_items / 2)
+            return 1LL << i;
+    }
+
+    return 1LL << (TQ_LATENCY_BUCKETS - 1);
+}
+
+void sch_stats_print(Scheduler *sch, AVBPrint *bp, int is_last)
+{
+    const int64_t now = av_gettime_relative();
+    const SchTask *task;
+    int first = 1;
+
+    av_bprintf(bp, "{\"time_us\":%"PRId64",\"last\":%s,\"tasks\":[",
+               now, is_last ? "true" : "false");
+
+    for (unsigned i = 0; (task = task_get(sch, i)); i++) {
+        ThreadQueue *tq;
+        TaskStats ts;
+
+        tq = task_queue(sch, task);
+
+        if (!task_stats_get(task, now, &ts))
+            continue;
+
+        av_bprintf(bp, "%s{\"type\":\"%s\",\"idx\":%u,"
+                   "\"busy_us\":%"PRId64",\"idle_us\":%"PRId64",\"blocked_us\":%"PRId64,
+                   first ? "" : ",", node_type_name(task->node.type), task->node.idx,
+                   ts.time_busy, ts.time_idle, ts.time_blocked);
+        first = 0;
+
+        if (tq) {
+            ThreadQueueStats qs;
+
+            tq_stats(tq, &qs);
+
+            av_bprintf(bp, ",\"queue\":{\"len\":%zu,\"max_len\":%zu,"
+                       "\"items\":%"PRIu64",\"latency_log2_us\":[",
+                       qs.queued, qs.queued_max, qs.nb_items);
+            for (int j = 0; j < TQ_LATENCY_BUCKETS; j++)
+                av_bprintf(bp, "%s%"PRIu64, j ? "," : "", qs.latency[j]);
+            av_bprintf(bp, "]}");
+        }
+
+        av_bprintf(bp, "}");
+    }
+
+    av_bprintf(bp, "]}\n");
+}
+
+void sch_stats_log(Scheduler *sch, int level)
+{
+    const int64_t now = av_gettime_relative();
+    const SchTask *task;
+
+    for (unsigned i = 0; (task = task_get(sch, i)); i++) {
+        ThreadQueue *tq;
+        TaskStats ts;
+        int64_t total;
+
+        tq = task_queue(sch, task);
+
+        if (!task_stats_get(task, now, &ts))
+            continue;
+
+        total = FFMAX(ts.time_busy + ts.time_idle + ts.time_blocked, 1);
+
+        av_log(task->func_arg, level,
+               "%s busy %.1f%% idle %.1f%% blocked %.1f%%",
+               node_type_name(task->node.type),
+               100.0 * ts.time_busy    / total,
+               100.0 * ts.time_idle    / total,
+               100.0 * ts.time_blocked / total);
+
+        if (tq) {
+            ThreadQueueStats qs;
+
+            tq_stats(tq, &qs);
+
+            av_log(task->func_arg, level,
+                   "; input queue: %"PRIu64" items, max length %zu, median latency <%"PRId64"us",
+                   qs.nb_items, qs.queued_max, latency_median(&qs));
+        }
+
+        av_log(task->func_arg, level, "\n");
+    }
+}
@@ -27,6 +27,8 @@
 
 #include "ffmpeg_utils.h"
 
+#include "libavutil/bprint.h"
+
 /*
  * This file contains the API for the transcode scheduler.
  *
@@ -130,6 +132,69 @@ typedef int (*SchThreadFunc)(void *arg);
 Scheduler *sch_alloc(void);
 void sch_free(Scheduler **sch);
 
+/**
+ * Limit the number of tasks that may run at the same time.
+ *
+ * A task gives up its running slot whenever it calls into the scheduler and
+ * reacquires it before returning, so that only the time spent outside of the
+ * scheduler (i.e. actually demuxing, decoding, filtering or encoding) is
+ * limited. Opening an encoder, which the task sending it its first frame
+ * does inside the scheduler, also takes a slot. Muxing tasks are not counted.
+ * Every task still runs in its own thread.
+ *
+ * Must be called before sch_start().
+ *
+ * @param nb_tasks maximum number of running tasks, 0 for no limit
+ */
+void sch_max_running_tasks(Scheduler *sch, unsigned nb_tasks);
+
+/**
+ * Set a target for the total memory used by data waiting in the queues between
+ * tasks.
+ *
+ * With a target set, queue lengths adapt to the data flowing through them:
+ * packet queues may grow beyond their nominal size (e.g. the thread_queue_size
+ * passed to sch_add_mux()) to absorb bursts, as long as the total stays within
+ * the target; frame queues may shrink down to a single frame when the frames
+ * are too large to fit into it.
+ *
+ * This is not a hard limit: to avoid deadlocks, packet queues always accept
+ * their nominal size and frame queues a single frame, whatever their size, so
+ * the total may exceed the target.
+ *
+ * Must be called before sch_start().
+ *
+ * @param max target amount of memory in bytes, 0 for none
+ */
+void sch_queue_mem_target(Scheduler *sch, size_t max);
+
+/**
+ * Collect per-task timing and per-queue occupancy/latency statistics, which can
+ * be retrieved with sch_stats_print() or sch_stats_log().
+ *
+ * Must be called before sch_start().
+ */
+void sch_enable_stats(Scheduler *sch);
+
+/**
+ * Print the current statistics as a single line of JSON.
+ *
+ * For every task this contains the time it spent working, waiting for input
+ * (idle) and waiting for its output to be accepted (blocked), and for its input
+ * queue the current and maximum length, the number of items that passed
+ * through it and a histogram of the time they spent in the queue. Bucket 0 of
+ * the histogram counts items that spent less than 1us in the queue, bucket
+ * i > 0 those that spent [2^(i-1), 2^i) us. This only covers the time between
+ * an item being sent to the queue and being received from it, not the time
+ * the sender was blocked before it could be queued nor any processing.
+ */
+void sch_stats_print(Scheduler *sch, AVBPrint *bp, int is_last);
+
+/**
+ * Log a human-readable summary of the statistics, one line per task.
+ */
+void sch_stats_log(Scheduler *sch, int level);
+
 int sch_start(Scheduler *sch);
 int sch_stop(Scheduler *sch, int64_t *finish_ts);
 
@@ -166,6 +231,35 @@ int sch_add_demux(Scheduler *sch, SchThreadFunc func, void *ctx);
  */
 int sch_add_demux_stream(Scheduler *sch, unsigned demux_idx);
 
+/**
+ * Restrict the demuxer thread to the given CPUs. Decoders fed by this demuxer
+ * inherit the restriction.
+ *
+ * @param demux_idx index previously returned by sch_add_demux()
+ * @param cpus comma-separated list of CPU numbers or ranges, e.g. "0-7,16"
+ *
+ * @retval 0 success
+ * @retval AVERROR(EINVAL) invalid CPU list
+ * @retval AVERROR(ENOSYS) not supported on this platform
+ */
+int sch_demux_affinity(Scheduler *sch, unsigned demux_idx, const char *cpus);
+
+/**
+ * Restrict the calling thread to the CPUs set with sch_demux_affinity(), if
+ * any, until sch_demux_affinity_leave() is called. This is used when opening
+ * the decoders fed by this demuxer, so that their worker threads inherit the
+ * restriction.
+ *
+ * @param demux_idx index previously returned by sch_add_demux()
+ */
+void sch_demux_affinity_enter(Scheduler *sch, unsigned demux_idx);
+
+/**
+ * Restore the CPUs of the calling thread as they were before the matching
+ * sch_demux_affinity_enter() call.
+ */
+void sch_demux_affinity_leave(Scheduler *sch, unsigned demux_idx);
+
 /**
  * Add a decoder to the scheduler.
  *
@@ -273,6 +367,20 @@ int sch_add_mux_stream(Scheduler *sch, unsigned mux_idx);
 void sch_mux_stream_buffering(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
                               size_t data_threshold, int max_packets);
 
+/**
+ * Restrict the muxer thread to the given CPUs. Encoders feeding this muxer
+ * inherit the restriction, as do filtergraphs whose outputs all go to
+ * encoders with the same restriction.
+ *
+ * @param mux_idx index previously returned by sch_add_mux()
+ * @param cpus comma-separated list of CPU numbers or ranges, e.g. "0-7,16"
+ *
+ * @retval 0 success
+ * @retval AVERROR(EINVAL) invalid CPU list
+ * @retval AVERROR(ENOSYS) not supported on this platform
+ */
+int sch_mux_affinity(Scheduler *sch, unsigned mux_idx, const char *cpus);
+
 /**
  * Signal to the scheduler that the specified muxed stream is initialized and
  * ready. Muxing is started once all the streams are ready.
@@ -0,0 +1,339 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Job server: keep one initialized ffmpeg process around and fork it for
+ * every job submitted over a UNIX socket.
+ *
+ * A client connects and sends the command line of the job, without the
+ * program name, as a sequence of NUL-terminated arguments followed by an
+ * empty one. The job then runs in a child process whose standard input,
+ * output and error are the connection, so the client receives the log and
+ * progress output and can send interactive commands, e.g. 'q' to stop the
+ * job. Closing the connection cancels the job. When the job has finished,
+ * the server sends a last "exit_status=<n>" line and closes the connection.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+
+#include "ffmpeg.h"
+
+// limit on the size of a job command line
+#define JOB_ARGS_MAX (1 << 20)
+
+typedef struct Job {
+    pid_t   pid;
+    // the connection to the client, also owned by the child process
+    int     fd;
+    int     cancelled;
+} Job;
+
+static volatile sig_atomic_t server_stop;
+
+static void server_sig_handler(int sig)
+{
+    server_stop = 1;
+}
+
+/* Read the command line of a job, which is followed by the data the client
+ * sends to the job's standard input, so it is read byte by byte. */
+static int job_read_args(int fd, int *argc, char ***argv, const char *argv0)
+{
+    AVBPrint buf;
+    char **args = NULL;
+    int nb_args = 1, ret = 0;
+
+    av_bprint_init(&buf, 0, JOB_ARGS_MAX);
+
+    while (1) {
+        char c;
+        ssize_t n = read(fd, &c, 1);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            ret = n < 0 ? AVERROR(errno) : AVERROR_EOF;
+            goto fail;
+        }
+
+        // an empty argument terminates the command line
+        if (!c && (!buf.len || !buf.str[buf.len - 1]))
+            break;
+
+        av_bprint_append_data(&buf, &c, 1);
+        if (!av_bprint_is_complete(&buf)) {
+            ret = AVERROR(E2BIG);
+            goto fail;
+        }
+        nb_args += !c;
+    }
+
+    args = av_calloc(nb_args + 1, sizeof(*args));
+    if (!args) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    args[0] = av_strdup(argv0);
+    if (!args[0]) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 1, pos = 0; i < nb_args; i++) {
+        args[i] = av_strdup(buf.str + pos);
+        if (!args[i]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        pos += strlen(args[i]) + 1;
+    }
+
+    av_bprint_finalize(&buf, NULL);
+
+    *argc = nb_args;
+    *argv = args;
+
+    return 0;
+fail:
+    if (args) {
+        for (int i = 0; i < nb_args; i++)
+            av_freep(&args[i]);
+        av_freep(&args);
+    }
+    av_bprint_finalize(&buf, NULL);
+    return ret;
+}
+
+static void job_finish(Job *job, int status)
+{
+    char line[32];
+    int code = WIFEXITED(status)   ? WEXITSTATUS(status)     :
+               WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 255;
+    ssize_t ret;
+
+    av_log(NULL, AV_LOG_INFO, "Job %d finished with exit status %d%s\n",
+           (int)job->pid, code, job->cancelled ? " (cancelled)" : "");
+
+    snprintf(line, sizeof(line), "exit_status=%d\n", code);
+    ret = write(job->fd, line, strlen(line));
+    if (ret < 0) { /* the client is gone */ };
+
+    close(job->fd);
+}
+
+static int server_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd, ret;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        av_log(NULL, AV_LOG_FATAL, "Job server socket path too long: %s\n", path);
+        return AVERROR(ENAMETOOLONG);
+    }
+    av_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        goto fail;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0)
+        goto fail;
+
+    return fd;
+fail:
+    ret = AVERROR(errno);
+    av_log(NULL, AV_LOG_FATAL, "Cannot listen on %s: %s\n", path, av_err2str(ret));
+    if (fd >= 0)
+        close(fd);
+    return ret;
+}
+
+int job_server_run(int *argc, char ***argv)
+{
+    struct sigaction action = { .sa_handler = server_sig_handler };
+    struct sigaction old_int, old_term, old_pipe;
+    struct pollfd *pfds = NULL;
+    Job *jobs = NULL;
+    unsigned nb_jobs = 0;
+    const char *path;
+    int listen_fd, idx, ret = 1;
+
+    idx = locate_option(*argc, *argv, options, "job_server");
+    if (!idx)
+        return 0;
+    if (!(*argv)[idx + 1]) {
+        av_log(NULL, AV_LOG_FATAL, "Missing argument for option 'job_server'\n");
+        return AVERROR(EINVAL);
+    }
+    path = (*argv)[idx + 1];
+
+    listen_fd = server_listen(path);
+    if (listen_fd < 0)
+        return listen_fd;
+
+    // no SA_RESTART, so that a signal interrupts poll()
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT,  &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, &old_pipe);
+
+    av_log(NULL, AV_LOG_INFO, "Job server listening on %s\n", path);
+
+    while (!server_stop) {
+        struct pollfd *pfds_new;
+        pid_t pid;
+        int status;
+
+        pfds_new = av_realloc_array(pfds, nb_jobs + 1, sizeof(*pfds));
+        if (!pfds_new) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        pfds = pfds_new;
+
+        pfds[0] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        // only wait for hangups, the job itself reads from the connection
+        for (unsigned i = 0; i < nb_jobs; i++)
+            pfds[i + 1] = (struct pollfd){ .fd = jobs[i].fd };
+
+        if (poll(pfds, nb_jobs + 1, 100) < 0 && errno != EINTR) {
+            ret = AVERROR(errno);
+            av_log(NULL, AV_LOG_FATAL, "poll() failed: %s\n", av_err2str(ret));
+            break;
+        }
+
+        for (unsigned i = 0; i < nb_jobs; i++) {
+            if (!(pfds[i + 1].revents & (POLLHUP | POLLERR)) || jobs[i].cancelled)
+                continue;
+
+            av_log(NULL, AV_LOG_INFO, "Client of job %d disconnected, stopping it\n",
+                   (int)jobs[i].pid);
+            kill(jobs[i].pid, SIGTERM);
+            jobs[i].cancelled = 1;
+        }
+
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (unsigned i = 0; i < nb_jobs; i++) {
+                if (jobs[i].pid != pid)
+                    continue;
+
+                job_finish(&jobs[i], status);
+                jobs[i] = jobs[--nb_jobs];
+                break;
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            Job *jobs_new;
+            int fd = accept(listen_fd, NULL, NULL);
+
+            if (fd < 0) {
+                if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED)
+                    av_log(NULL, AV_LOG_ERROR, "accept() failed: %s\n",
+                           av_err2str(AVERROR(errno)));
+                continue;
+            }
+
+            jobs_new = av_realloc_array(jobs, nb_jobs + 1, sizeof(*jobs));
+            if (!jobs_new) {
+                close(fd);
+                continue;
+            }
+            jobs = jobs_new;
+
+            pid = fork();
+            if (pid < 0) {
+                av_log(NULL, AV_LOG_ERROR, "fork() failed: %s\n",
+                       av_err2str(AVERROR(errno)));
+                close(fd);
+                continue;
+            }
+
+            if (!pid) {
+                const char *argv0 = (*argv)[0];
+
+                // the job process, which takes over the connection
+                close(listen_fd);
+                for (unsigned i = 0; i < nb_jobs; i++)
+                    close(jobs[i].fd);
+                av_freep(&jobs);
+                av_freep(&pfds);
+
+                sigaction(SIGINT,  &old_int,  NULL);
+                sigaction(SIGTERM, &old_term, NULL);
+                sigaction(SIGPIPE, &old_pipe, NULL);
+
+                if (dup2(fd, 0) < 0 || dup2(fd, 1) < 0 || dup2(fd, 2) < 0)
+                    _exit(1);
+                if (fd > 2)
+                    close(fd);
+
+                ret = job_read_args(0, argc, argv, argv0);
+                if (ret < 0) {
+                    av_log(NULL, AV_LOG_FATAL, "Error reading the job command line: %s\n",
+                           av_err2str(ret));
+                    _exit(1);
+                }
+                parse_loglevel(*argc, *argv, options);
+
+                return 0;
+            }
+
+            av_log(NULL, AV_LOG_INFO, "Started job %d\n", (int)pid);
+            jobs[nb_jobs++] = (Job){ .pid = pid, .fd = fd };
+        }
+    }
+
+    close(listen_fd);
+    unlink(path);
+
+    // stop the remaining jobs gracefully and wait for them
+    for (unsigned i = 0; i < nb_jobs; i++)
+        kill(jobs[i].pid, SIGTERM);
+    for (unsigned i = 0; i < nb_jobs; i++) {
+        int status;
+
+        while (waitpid(jobs[i].pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        job_finish(&jobs[i], status);
+    }
+
+    av_freep(&jobs);
+    av_freep(&pfds);
+
+    return ret;
+}
@@ -0,0 +1,346 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffmpeg_trace.h"
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+typedef struct TraceEvent {
+    const char         *name;
+    char                label[64];
+    enum TraceCategory  cat;
+    // relative to the trace start, in microseconds
+    int64_t             ts;
+    // -1 for instantaneous events
+    int64_t             dur;
+} TraceEvent;
+
+/* Every thread records its events into its own buffer, without locking. The
+ * buffers are merged when writing them out in trace_close(). */
+typedef struct TraceThread {
+    pthread_t           thread;
+
+    TraceEvent         *events;
+    size_t           nb_events;
+    size_t              events_allocated;
+    // events not recorded because the buffer was full
+    size_t           nb_dropped;
+} TraceThread;
+
+// limits on the memory used for recording
+#define TRACE_MAX_THREADS   256
+#define TRACE_MAX_EVENTS    (1 << 16)
+
+static atomic_int      trace_enabled;
+
+// guards registering new threads
+static AVMutex         trace_lock = AV_MUTEX_INITIALIZER;
+
+static AVIOContext    *trace_io;
+static int64_t         trace_start;
+static int64_t         trace_duration = 10 * 1000000;
+// the thread that called trace_open()
+static pthread_t       trace_main_thread;
+
+// events are attributed to threads by their index in this array
+static TraceThread     threads[TRACE_MAX_THREADS];
+static atomic_uint  nb_threads;
+// threads not recorded because the array was full
+static atomic_uint  nb_threads_dropped;
+
+static const char *const cat_names[] = {
+    [TRACE_STARTUP] = "startup",
+    [TRACE_SCHED]   = "sched",
+};
+
+int trace_open(AVIOContext *io)
+{
+    avio_closep(&trace_io);
+
+    trace_io          = io;
+    trace_start       = av_gettime_relative();
+    trace_main_thread = pthread_self();
+
+    atomic_store(&trace_enabled, 1);
+
+    return 0;
+}
+
+void trace_set_duration(int64_t duration_us)
+{
+    trace_duration = duration_us;
+}
+
+int64_t trace_begin(void)
+{
+    int64_t now;
+
+    if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed))
+        return 0;
+
+    now = av_gettime_relative();
+    return (now - trace_start < trace_duration) ? now : 0;
+}
+
+static TraceThread *thread_get(void)
+{
+    pthread_t self = pthread_self();
+    unsigned nb = atomic_load(&nb_threads);
+    TraceThread *t = NULL;
+
+    // the entries below nb_threads are never modified
+    for (unsigned i = 0; i < nb; i++)
+        if (pthread_equal(threads[i].thread, self))
+            return &threads[i];
+
+    // only the calling thread may add itself, so it cannot have been added
+    // since the lookup above
+    ff_mutex_lock(&trace_lock);
+
+    nb = atomic_load(&nb_threads);
+    if (nb < FF_ARRAY_ELEMS(threads)) {
+        t = &threads[nb];
+        t->thread = self;
+        atomic_store(&nb_threads, nb + 1);
+    } else
+        atomic_fetch_add(&nb_threads_dropped, 1);
+
+    ff_mutex_unlock(&trace_lock);
+
+    return t;
+}
+
+static void event_add(enum TraceCategory cat, void *logctx, const char *name,
+                      int64_t start, int64_t dur)
+{
+    const AVClass *class = logctx ? *(const AVClass**)logctx : NULL;
+    TraceThread *t;
+    TraceEvent *ev;
+
+    if (!atomic_load(&trace_enabled))
+        return;
+
+    t = thread_get();
+    if (!t)
+        return;
+
+    if (t->nb_events >= t->events_allocated) {
+        size_t size = FFMAX(2 * t->events_allocated, 256);
+        TraceEvent *tmp;
+
+        if (t->events_allocated >= TRACE_MAX_EVENTS) {
+            t->nb_dropped++;
+            return;
+        }
+
+        size = FFMIN(size, TRACE_MAX_EVENTS);
+        tmp  = av_realloc_array(t->events, size, sizeof(*t->events));
+        if (!tmp) {
+            t->nb_dropped++;
+            return;
+        }
+
+        t->events           = tmp;
+        t->events_allocated = size;
+    }
+
+    ev = &t->events[t->nb_events++];
+
+    ev->name = name;
+    ev->cat  = cat;
+    ev->ts   = start - trace_start;
+    ev->dur  = dur;
+    av_strlcpy(ev->label, class ? class->item_name(logctx) : "ffmpeg",
+               sizeof(ev->label));
+}
+
+void trace_end(int64_t start, enum TraceCategory cat,
+               void *logctx, const char *name)
+{
+    if (!start)
+        return;
+
+    event_add(cat, logctx, name, start, av_gettime_relative() - start);
+}
+
+void trace_mark(enum TraceCategory cat, void *logctx, const char *name)
+{
+    int64_t now = trace_begin();
+
+    if (!now)
+        return;
+
+    event_add(cat, logctx, name, now, -1);
+}
+
+static void write_escaped(AVIOContext *io, const char *str)
+{
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            avio_w8(io, '\\');
+        if ((unsigned char)*str >= 0x20)
+            avio_w8(io, *str);
+    }
+}
+
+static void write_events(AVIOContext *io)
+{
+    unsigned nb = atomic_load(&nb_threads);
+    int first = 1;
+
+    avio_printf(io, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (unsigned tid = 0; tid < nb; tid++) {
+        const TraceThread *t = &threads[tid];
+
+        for (size_t i = 0; i < t->nb_events; i++) {
+            const TraceEvent *ev = &t->events[i];
+
+            avio_printf(io, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\","
+                        "\"pid\":0,\"tid\":%u,\"ts\":%"PRId64,
+                        first ? "" : ",", ev->name, cat_names[ev->cat],
+                        ev->dur < 0 ? "i" : "X", tid, ev->ts);
+            if (ev->dur < 0)
+                avio_printf(io, ",\"s\":\"t\"");
+            else
+                avio_printf(io, ",\"dur\":%"PRId64, ev->dur);
+
+            avio_printf(io, ",\"args\":{\"component\":\"");
+            write_escaped(io, ev->label);
+            avio_printf(io, "\"}}");
+            first = 0;
+        }
+    }
+
+    // name each thread after the component of the first event recorded on it
+    for (unsigned tid = 0; tid < nb; tid++) {
+        const TraceThread *t = &threads[tid];
+
+        if (!t->nb_events)
+            continue;
+
+        avio_printf(io, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                    "\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"",
+                    first ? "" : ",", tid);
+        write_escaped(io, pthread_equal(t->thread, trace_main_thread) ?
+                          "main" : t->events[0].label);
+        avio_printf(io, "\"}}");
+        first = 0;
+    }
+
+    avio_printf(io, "\n]}\n");
+}
+
+static int event_cmp_ts(const void *a, const void *b)
+{
+    const TraceEvent *ev0 = *(const TraceEvent * const *)a;
+    const TraceEvent *ev1 = *(const TraceEvent * const *)b;
+    return FFDIFFSIGN(ev0->ts, ev1->ts);
+}
+
+static void log_summary(void)
+{
+    unsigned nb = atomic_load(&nb_threads);
+    const TraceEvent **startup = NULL;
+    size_t nb_startup = 0, nb_dropped = 0;
+
+    for (unsigned tid = 0; tid < nb; tid++) {
+        const TraceThread *t = &threads[tid];
+
+        nb_dropped += t->nb_dropped;
+        for (size_t i = 0; i < t->nb_events; i++)
+            nb_startup += t->events[i].cat == TRACE_STARTUP;
+    }
+
+    if (nb_dropped || atomic_load(&nb_threads_dropped))
+        av_log(NULL, AV_LOG_WARNING, "Startup report incomplete: %zu events "
+               "and %u threads were not recorded\n",
+               nb_dropped, atomic_load(&nb_threads_dropped));
+
+    if (!nb_startup)
+        return;
+
+    // merge the startup events of all the threads in chronological order
+    startup = av_malloc_array(nb_startup, sizeof(*startup));
+    if (!startup)
+        return;
+
+    nb_startup = 0;
+    for (unsigned tid = 0; tid < nb; tid++) {
+        const TraceThread *t = &threads[tid];
+
+        for (size_t i = 0; i < t->nb_events; i++)
+            if (t->events[i].cat == TRACE_STARTUP)
+                startup[nb_startup++] = &t->events[i];
+    }
+    qsort(startup, nb_startup, sizeof(*startup), event_cmp_ts);
+
+    av_log(NULL, AV_LOG_INFO, "Startup report (times in ms):\n");
+
+    for (size_t i = 0; i < nb_startup; i++) {
+        const TraceEvent *ev = startup[i];
+
+        if (ev->dur < 0)
+            av_log(NULL, AV_LOG_INFO, "  %9.3f            %-24s %s\n",
+                   ev->ts / 1000.0, ev->name, ev->label);
+        else
+            av_log(NULL, AV_LOG_INFO, "  %9.3f +%9.3f %-24s %s\n",
+                   ev->ts / 1000.0, ev->dur / 1000.0, ev->name, ev->label);
+    }
+
+    av_free(startup);
+}
+
+int trace_close(void)
+{
+    unsigned nb = atomic_load(&nb_threads);
+    int ret = 0;
+
+    if (!trace_io)
+        return 0;
+
+    atomic_store(&trace_enabled, 0);
+
+    log_summary();
+
+    write_events(trace_io);
+    ret = avio_closep(&trace_io);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error closing startup report: %s\n",
+               av_err2str(ret));
+
+    for (unsigned tid = 0; tid < nb; tid++)
+        av_freep(&threads[tid].events);
+    memset(threads, 0, sizeof(threads));
+    atomic_store(&nb_threads,         0);
+    atomic_store(&nb_threads_dropped, 0);
+
+    return ret;
+}
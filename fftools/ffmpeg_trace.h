@@ -0,0 +1,88 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFTOOLS_FFMPEG_TRACE_H
+#define FFTOOLS_FFMPEG_TRACE_H
+
+#include <stdint.h>
+
+#include "libavformat/avio.h"
+
+/**
+ * A process-wide recorder of timed events, written out in the Chrome
+ * trace-event JSON format and summarized in the log on trace_close().
+ *
+ * All functions except trace_open(), trace_set_duration() and trace_close()
+ * may be called from any thread. When tracing is not enabled, they reduce to
+ * a single atomic load. Every thread records into its own bounded buffer,
+ * so recording an event does not take any lock.
+ */
+
+enum TraceCategory {
+    /**
+     * One-time setup phases, such as opening a file or a codec. These are
+     * also listed in the log summary.
+     */
+    TRACE_STARTUP,
+    /**
+     * Scheduling events, such as a thread waiting for input or output.
+     */
+    TRACE_SCHED,
+};
+
+/**
+ * Start recording events, to be written to io by trace_close(). Takes
+ * ownership of io.
+ */
+int trace_open(AVIOContext *io);
+
+/**
+ * Only record events starting within duration_us microseconds from
+ * trace_open().
+ */
+void trace_set_duration(int64_t duration_us);
+
+/**
+ * Write all the recorded events, log the summary of the startup events and
+ * free all resources. Must only be called once no other thread can record
+ * events anymore.
+ */
+int trace_close(void);
+
+/**
+ * @return timestamp to be passed to trace_end() for an event starting now,
+ *         0 if this event is not to be recorded
+ */
+int64_t trace_begin(void);
+
+/**
+ * Record an event that started at the time returned by trace_begin().
+ *
+ * @param logctx logging context of the component the event happened in,
+ *               used to label the event
+ * @param name   event name, must be a static string
+ */
+void trace_end(int64_t start, enum TraceCategory cat,
+               void *logctx, const char *name);
+
+/**
+ * Record an instantaneous event happening now.
+ */
+void trace_mark(enum TraceCategory cat, void *logctx, const char *name);
+
+#endif /* FFTOOLS_FFMPEG_TRACE_H */
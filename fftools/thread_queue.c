@@ -16,15 +16,18 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "libavutil/avassert.h"
+#include "libavutil/common.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #include "objpool.h"
 #include "thread_queue.h"
@@ -37,6 +40,10 @@ enum {
 typedef struct FifoElem {
     void        *obj;
     unsigned int stream_idx;
+    // time the item was sent, only set when collecting statistics
+    int64_t      ts;
+    // memory used by the item, only set with a memory limit
+    size_t       size;
 } FifoElem;
 
 struct ThreadQueue {
@@ -44,14 +51,142 @@ struct ThreadQueue {
     unsigned int    nb_streams;
 
     AVFifo  *fifo;
+    size_t   fifo_size;
 
     ObjPool *obj_pool;
     void   (*obj_move)(void *dst, void *src);
 
     pthread_mutex_t lock;
     pthread_cond_t  cond;
+
+    /* THREAD_QUEUE_FLAG_SPSC mode; the fifo and the finished array are unused
+     * and replaced by the following */
+    int              spsc;
+    // ring_size objects owned by the queue, allocated by the sender on
+    // first use
+    void           **ring;
+    size_t           ring_size;
+    // total number of items read, only written by the receiving thread
+    atomic_size_t    ring_head;
+    // total number of items written, only written by the sending thread
+    atomic_size_t    ring_tail;
+    atomic_int       ring_finished;
+    // number of threads sleeping on cond, modified with lock held
+    atomic_int       nb_waiting;
+    // send times of the items in ring, only used when collecting statistics
+    int64_t         *ring_ts;
+    // sizes of the items in ring, only used with a memory limit
+    size_t          *ring_obj_size;
+
+    // see tq_set_mem_limit()
+    TQMemLimit      *mem_limit;
+    size_t           mem_min_items;
+    size_t         (*obj_size)(void *obj);
+
+    /* statistics, only updated with THREAD_QUEUE_FLAG_STATS;
+     * written by the sending/receiving threads, read by tq_stats() */
+    int                   stats;
+    atomic_size_t         stats_queued_max;
+    atomic_uint_least64_t stats_nb_items;
+    atomic_uint_least64_t stats_latency[TQ_LATENCY_BUCKETS];
 };
 
+int tq_mem_limit_init(TQMemLimit *limit, size_t max)
+{
+    int ret;
+
+    memset(limit, 0, sizeof(*limit));
+
+    ret = pthread_mutex_init(&limit->lock, NULL);
+    if (ret)
+        return AVERROR(ret);
+
+    ret = pthread_cond_init(&limit->cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&limit->lock);
+        return AVERROR(ret);
+    }
+
+    atomic_init(&limit->used,       0);
+    atomic_init(&limit->nb_waiting, 0);
+    atomic_init(&limit->gen,        0);
+    limit->max = max;
+
+    return 0;
+}
+
+void tq_mem_limit_uninit(TQMemLimit *limit)
+{
+    pthread_cond_destroy(&limit->cond);
+    pthread_mutex_destroy(&limit->lock);
+}
+
+/* Wake up the senders waiting for memory in mem_wait(). May be called with
+ * a queue lock held, so mem_wait() must not take a queue lock while holding
+ * the limit's lock. */
+static void mem_wake(ThreadQueue *tq)
+{
+    TQMemLimit *limit = tq->mem_limit;
+
+    if (!limit || !atomic_load(&limit->nb_waiting))
+        return;
+
+    pthread_mutex_lock(&limit->lock);
+    atomic_fetch_add(&limit->gen, 1);
+    pthread_cond_broadcast(&limit->cond);
+    pthread_mutex_unlock(&limit->lock);
+}
+
+static void mem_release(ThreadQueue *tq, size_t size)
+{
+    if (!tq->mem_limit)
+        return;
+
+    atomic_fetch_sub(&tq->mem_limit->used, size);
+    mem_wake(tq);
+}
+
+/* A sender whose item does not fit into the memory budget calls
+ * mem_wait_begin(), checks again whether it can send, and if not, calls
+ * mem_wait() to sleep until memory is released by any of the queues sharing
+ * the budget or its own receiver finishes. The budget or the finished state
+ * change either before the check, or after the waiter was counted, in which
+ * case gen is bumped. */
+static unsigned mem_wait_begin(ThreadQueue *tq)
+{
+    atomic_fetch_add(&tq->mem_limit->nb_waiting, 1);
+    return atomic_load(&tq->mem_limit->gen);
+}
+
+static void mem_wait(ThreadQueue *tq, unsigned gen, int blocked)
+{
+    TQMemLimit *limit = tq->mem_limit;
+
+    if (blocked) {
+        pthread_mutex_lock(&limit->lock);
+        while (atomic_load(&limit->gen) == gen)
+            pthread_cond_wait(&limit->cond, &limit->lock);
+        pthread_mutex_unlock(&limit->lock);
+    }
+
+    atomic_fetch_sub(&limit->nb_waiting, 1);
+}
+
+/**
+ * Check whether an item of the given size may be added to the queue, which
+ * currently contains queued items.
+ */
+static int can_send(const ThreadQueue *tq, size_t queued, size_t queue_size,
+                    size_t size)
+{
+    if (queued >= queue_size)
+        return 0;
+    if (!tq->mem_limit || queued < tq->mem_min_items)
+        return 1;
+
+    return atomic_load(&tq->mem_limit->used) + size <= tq->mem_limit->max;
+}
+
 void tq_free(ThreadQueue **ptq)
 {
     ThreadQueue *tq = *ptq;
@@ -61,11 +196,27 @@ void tq_free(ThreadQueue **ptq)
 
     if (tq->fifo) {
         FifoElem elem;
-        while (av_fifo_read(tq->fifo, &elem, 1) >= 0)
+        while (av_fifo_read(tq->fifo, &elem, 1) >= 0) {
+            mem_release(tq, elem.size);
             objpool_release(tq->obj_pool, &elem.obj);
+        }
     }
     av_fifo_freep2(&tq->fifo);
 
+    if (tq->ring) {
+        size_t head = atomic_load(&tq->ring_head);
+        size_t tail = atomic_load(&tq->ring_tail);
+
+        for (size_t i = head; tq->ring_obj_size && i != tail; i++)
+            mem_release(tq, tq->ring_obj_size[i % tq->ring_size]);
+
+        for (size_t i = 0; i < tq->ring_size; i++)
+            objpool_release(tq->obj_pool, &tq->ring[i]);
+        av_freep(&tq->ring);
+    }
+    av_freep(&tq->ring_ts);
+    av_freep(&tq->ring_obj_size);
+
     objpool_free(&tq->obj_pool);
 
     av_freep(&tq->finished);
@@ -76,8 +227,34 @@ void tq_free(ThreadQueue **ptq)
     av_freep(ptq);
 }
 
+static int ring_alloc(ThreadQueue *tq, size_t queue_size)
+{
+    tq->ring = av_calloc(queue_size, sizeof(*tq->ring));
+    if (!tq->ring)
+        return AVERROR(ENOMEM);
+    tq->ring_size = queue_size;
+
+    if (tq->stats) {
+        tq->ring_ts = av_calloc(queue_size, sizeof(*tq->ring_ts));
+        if (!tq->ring_ts) {
+            av_freep(&tq->ring);
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    atomic_init(&tq->ring_head,     0);
+    atomic_init(&tq->ring_tail,     0);
+    atomic_init(&tq->ring_finished, 0);
+    atomic_init(&tq->nb_waiting,    0);
+
+    tq->spsc = 1;
+
+    return 0;
+}
+
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src))
+                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src),
+                      unsigned flags)
 {
     ThreadQueue *tq;
     int ret;
@@ -104,26 +281,204 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
         goto fail;
     tq->nb_streams = nb_streams;
 
+    tq->obj_pool = obj_pool;
+    tq->obj_move = obj_move;
+
+    tq->stats = !!(flags & THREAD_QUEUE_FLAG_STATS);
+    atomic_init(&tq->stats_queued_max, 0);
+    atomic_init(&tq->stats_nb_items,   0);
+    for (int i = 0; i < FF_ARRAY_ELEMS(tq->stats_latency); i++)
+        atomic_init(&tq->stats_latency[i], 0);
+
+    if (flags & THREAD_QUEUE_FLAG_SPSC) {
+        av_assert0(nb_streams == 1);
+
+        if (ring_alloc(tq, queue_size) < 0)
+            goto fail;
+
+        return tq;
+    }
+
     tq->fifo = av_fifo_alloc2(queue_size, sizeof(FifoElem), 0);
     if (!tq->fifo)
         goto fail;
-
-    tq->obj_pool = obj_pool;
-    tq->obj_move = obj_move;
+    tq->fifo_size = queue_size;
 
     return tq;
 fail:
+    // the pool is owned by the caller on failure
+    tq->obj_pool = NULL;
     tq_free(&tq);
     return NULL;
 }
 
+// called by the sender, with the lock held in locked mode
+static void stats_sent(ThreadQueue *tq, size_t queued)
+{
+    if (queued > atomic_load_explicit(&tq->stats_queued_max, memory_order_relaxed))
+        atomic_store_explicit(&tq->stats_queued_max, queued, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tq->stats_nb_items, 1, memory_order_relaxed);
+}
+
+// called by the receiver
+static void stats_received(ThreadQueue *tq, int64_t ts)
+{
+    int64_t latency = av_gettime_relative() - ts;
+    int bucket = latency > 0 ? FFMIN(av_log2(latency) + 1, TQ_LATENCY_BUCKETS - 1) : 0;
+
+    atomic_fetch_add_explicit(&tq->stats_latency[bucket], 1, memory_order_relaxed);
+}
+
+/* Wake up the other side if it is sleeping. The waiting thread increments
+ * nb_waiting before re-checking the ring state, so either it observes our
+ * update or we observe it waiting. */
+static void ring_wake(ThreadQueue *tq)
+{
+    if (!atomic_load(&tq->nb_waiting))
+        return;
+
+    pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static void ring_set_finished(ThreadQueue *tq, int flag)
+{
+    pthread_mutex_lock(&tq->lock);
+    atomic_fetch_or(&tq->ring_finished, flag);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+
+    // the sender may be waiting for memory
+    mem_wake(tq);
+}
+
+static int ring_send(ThreadQueue *tq, void *data)
+{
+    size_t tail = atomic_load_explicit(&tq->ring_tail, memory_order_relaxed);
+    size_t size = tq->obj_size ? tq->obj_size(data) : 0;
+    size_t slot = tail % tq->ring_size;
+    size_t queued;
+
+    if (atomic_load(&tq->ring_finished) & FINISHED_SEND)
+        return AVERROR(EINVAL);
+
+    while (1) {
+        if (atomic_load(&tq->ring_finished) & FINISHED_RECV) {
+            atomic_fetch_or(&tq->ring_finished, FINISHED_SEND);
+            return AVERROR_EOF;
+        }
+
+        queued = tail - atomic_load(&tq->ring_head);
+        if (can_send(tq, queued, tq->ring_size, size))
+            break;
+
+        if (queued < tq->ring_size) {
+            // the item does not fit into the memory budget
+            unsigned gen = mem_wait_begin(tq);
+            mem_wait(tq, gen,
+                     !(atomic_load(&tq->ring_finished) & FINISHED_RECV) &&
+                     !can_send(tq, tail - atomic_load(&tq->ring_head),
+                               tq->ring_size, size));
+            continue;
+        }
+
+        // the ring is full, sleep until the receiver makes some space
+        pthread_mutex_lock(&tq->lock);
+        atomic_fetch_add(&tq->nb_waiting, 1);
+
+        while (!(atomic_load(&tq->ring_finished) & FINISHED_RECV) &&
+               !can_send(tq, tail - atomic_load(&tq->ring_head), tq->ring_size, size))
+            pthread_cond_wait(&tq->cond, &tq->lock);
+
+        atomic_fetch_sub(&tq->nb_waiting, 1);
+        pthread_mutex_unlock(&tq->lock);
+    }
+
+    if (!tq->ring[slot]) {
+        int ret = objpool_get(tq->obj_pool, &tq->ring[slot]);
+        if (ret < 0)
+            return ret;
+    }
+
+    tq->obj_move(tq->ring[slot], data);
+    if (tq->stats)
+        tq->ring_ts[slot] = av_gettime_relative();
+    if (tq->mem_limit) {
+        tq->ring_obj_size[slot] = size;
+        atomic_fetch_add(&tq->mem_limit->used, size);
+    }
+    atomic_store(&tq->ring_tail, tail + 1);
+
+    if (tq->stats)
+        stats_sent(tq, tail + 1 - atomic_load(&tq->ring_head));
+
+    ring_wake(tq);
+
+    return 0;
+}
+
+static int ring_receive(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    size_t head = atomic_load_explicit(&tq->ring_head, memory_order_relaxed);
+
+    while (1) {
+        // the finished state must be read before checking the ring, so that
+        // items sent before tq_send_finish() are not lost
+        int finished = atomic_load(&tq->ring_finished);
+
+        if (finished & FINISHED_RECV)
+            return AVERROR_EOF;
+
+        if (atomic_load(&tq->ring_tail) != head) {
+            size_t slot = head % tq->ring_size;
+
+            tq->obj_move(data, tq->ring[slot]);
+            if (tq->stats)
+                stats_received(tq, tq->ring_ts[slot]);
+            if (tq->mem_limit)
+                mem_release(tq, tq->ring_obj_size[slot]);
+            atomic_store(&tq->ring_head, head + 1);
+
+            ring_wake(tq);
+
+            *stream_idx = 0;
+            return 0;
+        }
+
+        if (finished & FINISHED_SEND) {
+            /* return EOF to the consumer at most once for the stream */
+            atomic_fetch_or(&tq->ring_finished, FINISHED_RECV);
+            *stream_idx = 0;
+            return AVERROR_EOF;
+        }
+
+        // the ring is empty, sleep until the sender gives us something
+        pthread_mutex_lock(&tq->lock);
+        atomic_fetch_add(&tq->nb_waiting, 1);
+
+        while (!atomic_load(&tq->ring_finished) &&
+               atomic_load(&tq->ring_tail) == head)
+            pthread_cond_wait(&tq->cond, &tq->lock);
+
+        atomic_fetch_sub(&tq->nb_waiting, 1);
+        pthread_mutex_unlock(&tq->lock);
+    }
+}
+
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
     int *finished;
+    size_t size;
     int ret;
 
     av_assert0(stream_idx < tq->nb_streams);
+
+    if (tq->spsc)
+        return ring_send(tq, data);
+
     finished = &tq->finished[stream_idx];
+    size     = tq->obj_size ? tq->obj_size(data) : 0;
 
     pthread_mutex_lock(&tq->lock);
 
@@ -132,8 +487,25 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         goto finish;
     }
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
-        pthread_cond_wait(&tq->cond, &tq->lock);
+    while (!(*finished & FINISHED_RECV) &&
+           !can_send(tq, av_fifo_can_read(tq->fifo), tq->fifo_size, size)) {
+        unsigned gen;
+        int blocked;
+
+        if (av_fifo_can_read(tq->fifo) >= tq->fifo_size) {
+            pthread_cond_wait(&tq->cond, &tq->lock);
+            continue;
+        }
+
+        // the item does not fit into the memory budget, which may also be
+        // freed by other queues, so wait on the budget without our lock
+        gen     = mem_wait_begin(tq);
+        blocked = !(*finished & FINISHED_RECV) &&
+                  !can_send(tq, av_fifo_can_read(tq->fifo), tq->fifo_size, size);
+        pthread_mutex_unlock(&tq->lock);
+        mem_wait(tq, gen, blocked);
+        pthread_mutex_lock(&tq->lock);
+    }
 
     if (*finished & FINISHED_RECV) {
         ret = AVERROR_EOF;
@@ -147,8 +519,18 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 
         tq->obj_move(elem.obj, data);
 
+        if (tq->stats)
+            elem.ts = av_gettime_relative();
+        if (tq->mem_limit) {
+            elem.size = size;
+            atomic_fetch_add(&tq->mem_limit->used, size);
+        }
+
         ret = av_fifo_write(tq->fifo, &elem, 1);
         av_assert0(ret >= 0);
+
+        if (tq->stats)
+            stats_sent(tq, av_fifo_can_read(tq->fifo));
         pthread_cond_broadcast(&tq->cond);
     }
 
@@ -165,6 +547,8 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
     unsigned int nb_finished = 0;
 
     while (av_fifo_read(tq->fifo, &elem, 1) >= 0) {
+        mem_release(tq, elem.size);
+
         if (tq->finished[elem.stream_idx] & FINISHED_RECV) {
             objpool_release(tq->obj_pool, &elem.obj);
             continue;
@@ -173,6 +557,10 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         tq->obj_move(data, elem.obj);
         objpool_release(tq->obj_pool, &elem.obj);
         *stream_idx = elem.stream_idx;
+
+        if (tq->stats)
+            stats_received(tq, elem.ts);
+
         return 0;
     }
 
@@ -199,6 +587,9 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 
     *stream_idx = -1;
 
+    if (tq->spsc)
+        return ring_receive(tq, stream_idx, data);
+
     pthread_mutex_lock(&tq->lock);
 
     while (1) {
@@ -227,6 +618,11 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->spsc) {
+        ring_set_finished(tq, FINISHED_SEND);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as send-finished;
@@ -242,6 +638,11 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->spsc) {
+        ring_set_finished(tq, FINISHED_RECV);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as recv-finished;
@@ -251,4 +652,48 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
     pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
+
+    // the sender may be waiting for memory
+    mem_wake(tq);
+}
+
+int tq_set_mem_limit(ThreadQueue *tq, TQMemLimit *limit, size_t min_items,
+                     size_t (*obj_size)(void *obj))
+{
+    av_assert0(min_items > 0);
+
+    if (tq->spsc) {
+        tq->ring_obj_size = av_calloc(tq->ring_size, sizeof(*tq->ring_obj_size));
+        if (!tq->ring_obj_size)
+            return AVERROR(ENOMEM);
+    }
+
+    tq->mem_limit     = limit;
+    tq->mem_min_items = min_items;
+    tq->obj_size      = obj_size;
+
+    return 0;
+}
+
+void tq_stats(ThreadQueue *tq, ThreadQueueStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (!tq->stats)
+        return;
+
+    if (tq->spsc) {
+        // read head first, so that the difference cannot underflow
+        size_t head = atomic_load(&tq->ring_head);
+        stats->queued = atomic_load(&tq->ring_tail) - head;
+    } else {
+        pthread_mutex_lock(&tq->lock);
+        stats->queued = av_fifo_can_read(tq->fifo);
+        pthread_mutex_unlock(&tq->lock);
+    }
+
+    stats->queued_max = atomic_load_explicit(&tq->stats_queued_max, memory_order_relaxed);
+    stats->nb_items   = atomic_load_explicit(&tq->stats_nb_items,   memory_order_relaxed);
+    for (int i = 0; i < FF_ARRAY_ELEMS(stats->latency); i++)
+        stats->latency[i] = atomic_load_explicit(&tq->stats_latency[i], memory_order_relaxed);
 }
@@ -19,12 +19,93 @@
 #ifndef FFTOOLS_THREAD_QUEUE_H
 #define FFTOOLS_THREAD_QUEUE_H
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "libavutil/thread.h"
+
 #include "objpool.h"
 
 typedef struct ThreadQueue ThreadQueue;
 
+enum ThreadQueueFlags {
+    /**
+     * The caller guarantees that there is only ever one thread sending to the
+     * queue and one thread receiving from it (or that all the senders are
+     * serialized by an external lock). This allows the queue to use a
+     * lock-free ring buffer and only touch its mutex when one of the sides
+     * needs to be put to sleep.
+     *
+     * Only valid for queues with a single stream.
+     */
+    THREAD_QUEUE_FLAG_SPSC = (1 << 0),
+    /**
+     * Collect statistics that can be retrieved with tq_stats().
+     */
+    THREAD_QUEUE_FLAG_STATS = (1 << 1),
+};
+
+/**
+ * Number of buckets in ThreadQueueStats.latency. Bucket 0 counts the items
+ * that spent less than 1 microsecond in the queue, bucket i > 0 counts the
+ * items that spent [2^(i-1), 2^i) microseconds. The last bucket also counts
+ * everything longer than that.
+ */
+#define TQ_LATENCY_BUCKETS 24
+
+/**
+ * Memory budget shared by a set of queues. Must be initialized with
+ * tq_mem_limit_init().
+ */
+typedef struct TQMemLimit {
+    /**
+     * Total memory currently used by the items in all the queues.
+     */
+    atomic_size_t   used;
+    /**
+     * Target for used. This is a soft limit, as each queue may always hold
+     * the min_items passed to tq_set_mem_limit(), whatever their size.
+     */
+    size_t          max;
+
+    /**
+     * Senders waiting for memory to be released by any of the queues sleep
+     * on cond until gen changes.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    atomic_int      nb_waiting;
+    atomic_uint     gen;
+} TQMemLimit;
+
+/**
+ * Initialize a memory budget with the given target, 0 for no limit.
+ */
+int  tq_mem_limit_init(TQMemLimit *limit, size_t max);
+void tq_mem_limit_uninit(TQMemLimit *limit);
+
+typedef struct ThreadQueueStats {
+    /**
+     * Number of items currently stored in the queue.
+     */
+    size_t      queued;
+    /**
+     * Highest number of items that were ever stored in the queue.
+     */
+    size_t      queued_max;
+    /**
+     * Total number of items sent through the queue.
+     */
+    uint64_t    nb_items;
+    /**
+     * Histogram of the time between sending and receiving an item, i.e. the
+     * time it spent in the queue. Time spent by tq_send() waiting for space
+     * in a full queue is not included.
+     */
+    uint64_t    latency[TQ_LATENCY_BUCKETS];
+} ThreadQueueStats;
+
 /**
  * Allocate a queue for sending data between threads.
  *
@@ -35,9 +116,11 @@ typedef struct ThreadQueue ThreadQueue;
  * @param obj_pool object pool that will be used to allocate items stored in the
  *                 queue; the pool becomes owned by the queue
  * @param callback that moves the contents between two data pointers
+ * @param flags a combination of THREAD_QUEUE_FLAG_*
  */
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src));
+                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src),
+                      unsigned flags);
 void         tq_free(ThreadQueue **tq);
 
 /**
@@ -78,4 +161,31 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * Make the queue length depend on the memory used by the queued items.
+ *
+ * The queue may always hold up to min_items items. Beyond that, sending blocks
+ * unless the new item fits into the memory budget shared with other queues,
+ * so that the queue length adapts between min_items and the queue_size passed
+ * to tq_alloc() depending on how far the consumer lags behind the producer and
+ * on the size of the items. A blocked sender is woken up when memory is
+ * released by any of the queues sharing the budget.
+ *
+ * Must be called before any items are sent.
+ *
+ * @param limit the shared budget, must outlive the queue
+ * @param min_items the number of items that may always be queued, must be
+ *                  at least 1
+ * @param obj_size callback returning the memory used by an item
+ */
+int tq_set_mem_limit(ThreadQueue *tq, TQMemLimit *limit, size_t min_items,
+                     size_t (*obj_size)(void *obj));
+
+/**
+ * Get the queue's statistics. May be called from any thread. The queue must
+ * have been allocated with THREAD_QUEUE_FLAG_STATS, otherwise the returned
+ * statistics are zeroed.
+ */
+void tq_stats(ThreadQueue *tq, ThreadQueueStats *stats);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
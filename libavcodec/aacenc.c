@@ -826,6 +826,52 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
+typedef struct AACQuantJob {
+    SingleChannelElement *sce;
+    enum RawDataBlockType type;                  ///< type of the element sce belongs to
+    int channel;
+    int alloc;                                   ///< psy bit reservoir allocation for the channel
+} AACQuantJob;
+
+static void update_thread_contexts(AACEncContext *s)
+{
+    for (int i = 0; i < s->nb_thread_ctx; i++) {
+        AACEncContext *t = &s->thread_ctx[i];
+        t->lambda = s->lambda;
+        t->psy    = s->psy;
+    }
+}
+
+static void merge_thread_contexts(AACEncContext *s)
+{
+    const int cutoff = s->psy.cutoff;
+
+    /* every channel searched in a pass computes the same cutoff, the copies
+     * that did not get any channel still hold the previous one */
+    for (int i = 0; i < s->nb_thread_ctx; i++)
+        if (s->thread_ctx[i].psy.cutoff != cutoff)
+            s->psy.cutoff = s->thread_ctx[i].psy.cutoff;
+}
+
+static int search_for_quantizers_job(AVCodecContext *avctx, void *arg,
+                                     int jobnr, int threadnr)
+{
+    AACEncContext *s = avctx->priv_data;
+    const AACQuantJob *job = (const AACQuantJob *)arg + jobnr;
+
+    if (s->nb_thread_ctx)
+        s = &s->thread_ctx[threadnr];
+
+    s->cur_type         = job->type;
+    s->cur_channel      = job->channel;
+    s->psy.bitres.alloc = job->alloc;
+    if (s->options.pns && s->coder->mark_pns)
+        s->coder->mark_pns(s, avctx, job->sce);
+    s->coder->search_for_quantizers(avctx, s, job->sce, s->lambda);
+
+    return 0;
+}
+
 static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                             const AVFrame *frame, int *got_packet_ptr)
 {
@@ -839,6 +885,7 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
     int chan_el_counter[4];
     FFPsyWindowInfo windows[AAC_MAX_CHANNELS];
+    AACQuantJob quant_jobs[AAC_MAX_CHANNELS];
 
     /* add current frame to queue */
     if (frame) {
@@ -961,7 +1008,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             put_bitstream_info(s, LIBAVCODEC_IDENT);
         start_ch = 0;
         target_bits = 0;
-        memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < s->chan_map[0]; i++) {
             FFPsyWindowInfo* wi = windows + start_ch;
             const float *coeffs[2];
@@ -971,8 +1017,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             cpe->common_window = 0;
             memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
             memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
-            put_bits(&s->pb, 3, tag);
-            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             for (ch = 0; ch < chans; ch++) {
                 sce = &cpe->ch[ch];
                 coeffs[ch] = sce->coeffs;
@@ -994,13 +1038,31 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
                 s->psy.bitres.alloc /= chans;
             }
-            s->cur_type = tag;
             for (ch = 0; ch < chans; ch++) {
-                s->cur_channel = start_ch + ch;
-                if (s->options.pns && s->coder->mark_pns)
-                    s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
+                quant_jobs[start_ch + ch].sce     = &cpe->ch[ch];
+                quant_jobs[start_ch + ch].type    = tag;
+                quant_jobs[start_ch + ch].channel = start_ch + ch;
+                quant_jobs[start_ch + ch].alloc   = s->psy.bitres.alloc;
             }
+            start_ch += chans;
+        }
+
+        /* The quantizer search of each channel only depends on its own
+         * coefficients and psy bands, so all channels are searched at once. */
+        update_thread_contexts(s);
+        avctx->execute2(avctx, search_for_quantizers_job, quant_jobs, NULL, s->channels);
+        merge_thread_contexts(s);
+
+        start_ch = 0;
+        memset(chan_el_counter, 0, sizeof(chan_el_counter));
+        for (i = 0; i < s->chan_map[0]; i++) {
+            FFPsyWindowInfo* wi = windows + start_ch;
+            tag      = s->chan_map[i+1];
+            chans    = tag == TYPE_CPE ? 2 : 1;
+            cpe      = &s->cpe[i];
+            s->cur_type = tag;
+            put_bits(&s->pb, 3, tag);
+            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             if (chans > 1
                 && wi[0].window_type[0] == wi[1].window_type[0]
                 && wi[0].window_shape   == wi[1].window_shape) {
@@ -1196,6 +1258,7 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     av_freep(&s->buffer.samples);
     av_freep(&s->cpe);
     av_freep(&s->fdsp);
+    av_freep(&s->thread_ctx);
     ff_af_queue_close(&s->afq);
     return 0;
 }
@@ -1384,6 +1447,17 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
 
     ff_af_queue_init(avctx, &s->afq);
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE) {
+        s->thread_ctx = av_malloc_array(avctx->thread_count, sizeof(*s->thread_ctx));
+        if (!s->thread_ctx)
+            return AVERROR(ENOMEM);
+        for (i = 0; i < avctx->thread_count; i++) {
+            memcpy(&s->thread_ctx[i], s, sizeof(*s));
+            s->thread_ctx[i].thread_ctx = NULL;
+        }
+        s->nb_thread_ctx = avctx->thread_count;
+    }
+
     return 0;
 }
 
@@ -1422,7 +1496,7 @@ const FFCodec ff_aac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_AAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(AACEncContext),
     .init           = aac_encode_init,
     FF_CODEC_ENCODE_CB(aac_encode_frame),
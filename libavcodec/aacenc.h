@@ -253,6 +253,13 @@ typedef struct AACEncContext {
     struct {
         float *samples;
     } buffer;
+
+    /**
+     * Copies of this context, one per slice thread, giving each thread its own
+     * scratch buffers and band cost cache for the quantizer search.
+     */
+    struct AACEncContext *thread_ctx;
+    int nb_thread_ctx;
 } AACEncContext;
 
 void ff_quantize_band_cost_cache_init(struct AACEncContext *s);
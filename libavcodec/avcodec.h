@@ -363,6 +363,15 @@ typedef struct RcOverride{
  * Place global headers at every keyframe instead of in extradata.
  */
 #define AV_CODEC_FLAG2_LOCAL_HEADER   (1 <<  3)
+/**
+ * With frame threading, return each decoded frame as soon as the thread
+ * decoding it has finished, instead of always keeping thread_count - 1
+ * frames in flight. Decoding only blocks once all the threads are busy.
+ * AVCodecContext.delay is unchanged, as up to thread_count - 1 frames are
+ * still held back when decoding is slower than the input.
+ * Only taken into account when the decoder is opened.
+ */
+#define AV_CODEC_FLAG2_EARLY_OUTPUT   (1 <<  4)
 
 /**
  * Input bitstream might be truncated at a packet boundaries
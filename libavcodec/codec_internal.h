@@ -87,6 +87,19 @@
  * encoders do.
  */
 #define FF_CODEC_CAP_EOF_FLUSH              (1 << 10)
+/**
+ * The encoder can code closed GOPs (AV_CODEC_FLAG_CLOSED_GOP) in parallel
+ * with frame threads, if enabled with its boolean "gop_threads" option.
+ * Each thread codes whole GOPs of AVCodecContext.gop_size frames with its
+ * own instance of the encoder, which is drained at the end of every GOP.
+ * Before every GOP, FFCodec.flush must restart the encoder as if it had
+ * just been opened, including all state carried between pictures, so
+ * that the output does not depend on which thread codes which GOP.
+ * FFCodec.update_gop_state is used to store the rate control state at
+ * the end of every thread_count-th GOP in the parent context and to seed
+ * the following thread_count GOPs from it.
+ */
+#define FF_CODEC_CAP_GOP_THREADS            (1 << 11)
 
 /**
  * FFCodec.codec_tags termination value
@@ -161,6 +174,12 @@ typedef struct FFCodec {
     int (*update_thread_context_for_user)(struct AVCodecContext *dst, const struct AVCodecContext *src);
     /** @} */
 
+    /**
+     * Copy the state carried between GOPs from src to dst,
+     * see FF_CODEC_CAP_GOP_THREADS. Encoders only.
+     */
+    int (*update_gop_state)(struct AVCodecContext *dst, const struct AVCodecContext *src);
+
     /**
      * Private codec-specific defaults.
      */
@@ -276,11 +295,15 @@ typedef struct FFCodec {
         .update_thread_context          = (func)
 #define UPDATE_THREAD_CONTEXT_FOR_USER(func) \
         .update_thread_context_for_user = (func)
+#define UPDATE_GOP_STATE(func) \
+        .update_gop_state               = (func)
 #else
 #define UPDATE_THREAD_CONTEXT(func) \
         .update_thread_context          = NULL
 #define UPDATE_THREAD_CONTEXT_FOR_USER(func) \
         .update_thread_context_for_user = NULL
+#define UPDATE_GOP_STATE(func) \
+        .update_gop_state               = NULL
 #endif
 
 #define FF_CODEC_DECODE_CB(func)                          \
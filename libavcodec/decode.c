@@ -400,12 +400,19 @@ static inline int decode_simple_internal(AVCodecContext *avctx, AVFrame *frame,
     AVPacket     *const pkt = avci->in_pkt;
     const FFCodec *const codec = ffcodec(avctx->codec);
     int got_frame, consumed;
+    int poll = 0;
     int ret;
 
     if (!pkt->data && !avci->draining) {
         av_packet_unref(pkt);
         ret = ff_decode_get_packet(avctx, pkt);
-        if (ret < 0 && ret != AVERROR_EOF)
+        // without new input, frame threads may still have finished frames
+        // to return early
+        if (ret == AVERROR(EAGAIN) && HAVE_THREADS &&
+            avctx->active_thread_type & FF_THREAD_FRAME &&
+            ff_thread_early_output(avctx))
+            poll = 1;
+        else if (ret < 0 && ret != AVERROR_EOF)
             return ret;
     }
 
@@ -503,6 +510,9 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
     }
 
+    if (poll && !got_frame && ret >= 0)
+        return AVERROR(EAGAIN);
+
     return ret;
 }
 
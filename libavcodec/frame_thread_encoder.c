@@ -29,24 +29,30 @@
 #include "libavutil/thread.h"
 #include "avcodec.h"
 #include "avcodec_internal.h"
+#include "codec_internal.h"
 #include "codec_par.h"
 #include "encode.h"
 #include "internal.h"
 #include "pthread_internal.h"
 
 #define MAX_THREADS 64
-/* There can be as many as MAX_THREADS + 1 outstanding tasks.
+/* There can be as many as MAX_THREADS + 1 outstanding tasks, + 2 when
+ * encoding GOPs, as the last one is submitted when flushing while the
+ * packets of the oldest one may still be being returned.
  * An additional + 1 is needed so that one can distinguish
- * the case of zero and MAX_THREADS + 1 outstanding tasks modulo
+ * the case of zero and MAX_THREADS + 2 outstanding tasks modulo
  * the number of buffers. */
-#define BUFFER_SIZE (MAX_THREADS + 2)
+#define BUFFER_SIZE (MAX_THREADS + 3)
 
 typedef struct{
-    AVFrame  *indata;
-    AVPacket *outdata;
-    int       return_code;
-    int       finished;
-    int       got_packet;
+    AVFrame  **indata;
+    AVPacket **outdata;
+    unsigned   nb_frames;
+    unsigned   nb_packets;
+    unsigned   next_packet;
+    int64_t    first_frame;  ///< index of indata[0] in the whole stream
+    int        return_code;
+    int        finished;
 } Task;
 
 typedef struct{
@@ -58,6 +64,31 @@ typedef struct{
     unsigned pthread_init_cnt;
     unsigned max_tasks;
     Task tasks[BUFFER_SIZE];
+
+    /**
+     * Number of frames per task. When closed GOPs are coded in parallel
+     * (gop_threads), each task is a whole GOP, which the worker codes with
+     * its instance of the encoder after restarting it.
+     */
+    unsigned gop_size;
+    unsigned max_packets;
+    int gop_threads;
+    int64_t nb_frames;
+    int64_t timecode_start;
+
+    /**
+     * The rate control of the GOPs is seeded deterministically: GOPs
+     * k * thread_count + 1 to (k + 1) * thread_count all start from the
+     * state after GOP k * thread_count, which is stored in the parent
+     * context, as that does not code anything itself.
+     */
+    pthread_mutex_t rc_mutex; /* Guards the following fields and the rate
+                               * control state of the parent context */
+    pthread_cond_t rc_cond;
+    int64_t rc_gen;           ///< k of the stored state, -1 if none yet
+    int rc_gen_ok;            ///< the GOP of the stored state was coded
+    int rc_seeded;            ///< number of GOPs seeded from it so far
+
     pthread_mutex_t finished_task_mutex; /* Guards tasks[i].finished */
     pthread_cond_t finished_task_cond;
 
@@ -71,18 +102,115 @@ typedef struct{
 
 #define OFF(member) offsetof(ThreadContext, member)
 DEFINE_OFFSET_ARRAY(ThreadContext, thread_ctx, pthread_init_cnt,
-                    (OFF(task_fifo_mutex), OFF(finished_task_mutex)),
-                    (OFF(task_fifo_cond),  OFF(finished_task_cond)));
+                    (OFF(task_fifo_mutex), OFF(rc_mutex), OFF(finished_task_mutex)),
+                    (OFF(task_fifo_cond),  OFF(rc_cond), OFF(finished_task_cond)));
 #undef OFF
 
+/**
+ * Restart the encoder of a worker for the GOP starting with frame
+ * first_frame of the stream.
+ */
+static int start_gop(ThreadContext *c, AVCodecContext *avctx,
+                     int64_t first_frame)
+{
+    const FFCodec *codec = ffcodec(avctx->codec);
+    int64_t gop = first_frame / c->gop_size;
+    int ret = 0;
+
+    codec->flush(avctx);
+
+    if (gop) {
+        int64_t gen = (gop - 1) / c->parent_avctx->thread_count;
+
+        pthread_mutex_lock(&c->rc_mutex);
+        while (c->rc_gen < gen)
+            pthread_cond_wait(&c->rc_cond, &c->rc_mutex);
+        av_assert0(c->rc_gen == gen);
+        if (c->rc_gen_ok)
+            ret = codec->update_gop_state(avctx, c->parent_avctx);
+        c->rc_seeded++;
+        pthread_cond_broadcast(&c->rc_cond);
+        pthread_mutex_unlock(&c->rc_mutex);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* The GOP timecode of the MPEG-1/2 encoders counts the pictures coded
+     * since the restart, start it where this GOP is in the whole stream. */
+    av_opt_set_int(avctx->priv_data, "timecode_frame_start",
+                   c->timecode_start + first_frame, 0);
+
+    return 0;
+}
+
+/**
+ * Store the rate control state after the GOP starting with frame
+ * first_frame if the following GOPs are seeded from it.
+ */
+static int finish_gop(ThreadContext *c, AVCodecContext *avctx,
+                      int64_t first_frame, int ret)
+{
+    int64_t gop = first_frame / c->gop_size;
+    int nb_threads = c->parent_avctx->thread_count;
+
+    if (gop % nb_threads)
+        return ret;
+
+    pthread_mutex_lock(&c->rc_mutex);
+    /* All GOPs seeded from the previous state, this one included, have
+     * been handed out to workers, so they are about to take it. */
+    while (gop && c->rc_seeded < nb_threads)
+        pthread_cond_wait(&c->rc_cond, &c->rc_mutex);
+    c->rc_gen_ok = ret >= 0;
+    if (ret >= 0) {
+        ret = ffcodec(avctx->codec)->update_gop_state(c->parent_avctx, avctx);
+        c->rc_gen_ok = ret >= 0;
+    }
+    c->rc_gen    = gop / nb_threads;
+    c->rc_seeded = 0;
+    pthread_cond_broadcast(&c->rc_cond);
+    pthread_mutex_unlock(&c->rc_mutex);
+
+    return ret;
+}
+
+static int encode_task(ThreadContext *c, AVCodecContext *avctx, Task *task)
+{
+    int got_packet, ret;
+
+    for (unsigned i = 0; i < task->nb_frames; i++) {
+        got_packet = 0;
+        ret = ff_encode_encode_cb(avctx, task->outdata[task->nb_packets],
+                                  task->indata[i], &got_packet);
+        av_frame_unref(task->indata[i]);
+        if (ret < 0)
+            return ret;
+        task->nb_packets += got_packet;
+    }
+
+    if (!c->gop_threads)
+        return 0;
+
+    /* Flush the GOP. There is room for one packet per frame and for the
+     * last call, which must not return any. */
+    do {
+        got_packet = 0;
+        ret = ff_encode_encode_cb(avctx, task->outdata[task->nb_packets],
+                                  NULL, &got_packet);
+        if (ret < 0)
+            return ret;
+        task->nb_packets += got_packet;
+    } while (got_packet && task->nb_packets <= task->nb_frames);
+
+    return task->nb_packets > task->nb_frames ? AVERROR_BUG : 0;
+}
+
 static void * attribute_align_arg worker(void *v){
     AVCodecContext *avctx = v;
     ThreadContext *c = avctx->internal->frame_thread_encoder;
 
     while (!atomic_load(&c->exit)) {
         int ret;
-        AVPacket *pkt;
-        AVFrame *frame;
         Task *task;
         unsigned task_index;
 
@@ -101,11 +229,15 @@ static void * attribute_align_arg worker(void *v){
          * different indices, ergo each worker thread owns its element
          * of c->tasks with the exception of finished, which is shared
          * with the main thread and guarded by finished_task_mutex. */
-        task  = &c->tasks[task_index];
-        frame = task->indata;
-        pkt   = task->outdata;
-
-        ret = ff_encode_encode_cb(avctx, pkt, frame, &task->got_packet);
+        task = &c->tasks[task_index];
+
+        ret = 0;
+        if (c->gop_threads)
+            ret = start_gop(c, avctx, task->first_frame);
+        if (ret >= 0)
+            ret = encode_task(c, avctx, task);
+        if (c->gop_threads)
+            ret = finish_gop(c, avctx, task->first_frame, ret);
         pthread_mutex_lock(&c->finished_task_mutex);
         task->return_code = ret;
         task->finished    = 1;
@@ -123,10 +255,42 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
     ThreadContext *c;
     AVCodecContext *thread_avctx = NULL;
     AVCodecParameters *par = NULL;
+    unsigned gop_size = 1;
+    int gop_threads = 0;
     int ret;
 
-    if(   !(avctx->thread_type & FF_THREAD_FRAME)
-       || !(avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS))
+    if (!(avctx->thread_type & FF_THREAD_FRAME))
+        return 0;
+
+    if (ffcodec(avctx->codec)->caps_internal & FF_CODEC_CAP_GOP_THREADS) {
+        int64_t tmp;
+
+        if (av_opt_get_int(avctx->priv_data, "gop_threads", 0, &tmp) < 0 || !tmp)
+            return 0;
+        /* Whole GOPs can only be coded concurrently if they do not
+         * reference each other. */
+        if (!(avctx->flags & AV_CODEC_FLAG_CLOSED_GOP)) {
+            av_log(avctx, AV_LOG_WARNING,
+                   "gop_threads requires closed GOPs, "
+                   "using slice threads instead\n");
+            return 0;
+        }
+        if (avctx->flags & (AV_CODEC_FLAG_PASS1 | AV_CODEC_FLAG_PASS2)) {
+            av_log(avctx, AV_LOG_WARNING,
+                   "gop_threads does not support two-pass encoding, "
+                   "using slice threads instead\n");
+            return 0;
+        }
+        /* The VBV occupancy depends on all preceding GOPs. */
+        if (avctx->rc_buffer_size || avctx->rc_max_rate) {
+            av_log(avctx, AV_LOG_WARNING,
+                   "gop_threads does not support rc_buffer_size and "
+                   "rc_max_rate, using slice threads instead\n");
+            return 0;
+        }
+        gop_size    = FFMAX(avctx->gop_size, 1);
+        gop_threads = 1;
+    } else if (!(avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS))
         return 0;
 
     if(   !avctx->thread_count
@@ -180,20 +344,37 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
     if(!c)
         return AVERROR(ENOMEM);
 
-    c->parent_avctx = avctx;
+    c->parent_avctx   = avctx;
+    c->gop_size       = gop_size;
+    c->max_packets    = gop_size + gop_threads;
+    c->gop_threads    = gop_threads;
+    c->rc_gen         = -1;
 
     ret = ff_pthread_init(c, thread_ctx_offsets);
     if (ret < 0)
         goto fail;
     atomic_init(&c->exit, 0);
 
-    c->max_tasks = avctx->thread_count + 2;
+    c->max_tasks = avctx->thread_count + 2 + gop_threads;
     for (unsigned j = 0; j < c->max_tasks; j++) {
-        if (!(c->tasks[j].indata  = av_frame_alloc()) ||
-            !(c->tasks[j].outdata = av_packet_alloc())) {
+        Task *task = &c->tasks[j];
+
+        task->indata  = av_calloc(gop_size, sizeof(*task->indata));
+        task->outdata = av_calloc(c->max_packets, sizeof(*task->outdata));
+        if (!task->indata || !task->outdata) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
+        for (unsigned k = 0; k < gop_size; k++)
+            if (!(task->indata[k] = av_frame_alloc())) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+        for (unsigned k = 0; k < c->max_packets; k++)
+            if (!(task->outdata[k] = av_packet_alloc())) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
     }
 
     par = avcodec_parameters_alloc();
@@ -250,6 +431,10 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
 
         if ((ret = avcodec_open2(thread_avctx, avctx->codec, NULL)) < 0)
             goto fail;
+        if (!i && gop_threads &&
+            av_opt_get_int(thread_avctx->priv_data, "timecode_frame_start",
+                           0, &c->timecode_start) < 0)
+            c->timecode_start = 0;
         av_assert0(!thread_avctx->internal->frame_thread_encoder);
         thread_avctx->internal->frame_thread_encoder = c;
         if ((ret = pthread_create(&c->worker[i], NULL, worker, thread_avctx))) {
@@ -290,51 +475,85 @@ av_cold void ff_frame_thread_encoder_free(AVCodecContext *avctx)
     }
 
     for (unsigned i = 0; i < c->max_tasks; i++) {
-        av_frame_free(&c->tasks[i].indata);
-        av_packet_free(&c->tasks[i].outdata);
+        Task *task = &c->tasks[i];
+
+        for (unsigned j = 0; task->indata && j < c->gop_size; j++)
+            av_frame_free(&task->indata[j]);
+        for (unsigned j = 0; task->outdata && j < c->max_packets; j++)
+            av_packet_free(&task->outdata[j]);
+        av_freep(&task->indata);
+        av_freep(&task->outdata);
     }
 
     ff_pthread_free(c, thread_ctx_offsets);
     av_freep(&avctx->internal->frame_thread_encoder);
 }
 
+static void submit_task(ThreadContext *c)
+{
+    pthread_mutex_lock(&c->task_fifo_mutex);
+    c->task_index = (c->task_index + 1) % c->max_tasks;
+    pthread_cond_signal(&c->task_fifo_cond);
+    pthread_mutex_unlock(&c->task_fifo_mutex);
+}
+
 int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
                                  AVFrame *frame, int *got_packet_ptr)
 {
     ThreadContext *c = avctx->internal->frame_thread_encoder;
+    Task *task = &c->tasks[c->task_index];
     Task *outtask;
+    int ret;
 
     av_assert1(!*got_packet_ptr);
 
     if(frame){
-        av_frame_move_ref(c->tasks[c->task_index].indata, frame);
-
-        pthread_mutex_lock(&c->task_fifo_mutex);
-        c->task_index = (c->task_index + 1) % c->max_tasks;
-        pthread_cond_signal(&c->task_fifo_cond);
-        pthread_mutex_unlock(&c->task_fifo_mutex);
+        if (!task->nb_frames)
+            task->first_frame = c->nb_frames;
+        av_frame_move_ref(task->indata[task->nb_frames++], frame);
+        c->nb_frames++;
+
+        if (task->nb_frames == c->gop_size)
+            submit_task(c);
+    } else if (task->nb_frames) {
+        /* the last GOP may be shorter */
+        submit_task(c);
     }
 
-    outtask = &c->tasks[c->finished_task_index];
-    pthread_mutex_lock(&c->finished_task_mutex);
-    /* The access to task_index in the following code is ok,
-     * because it is only ever changed by the main thread. */
-    if (c->task_index == c->finished_task_index ||
-        (frame && !outtask->finished &&
-         (c->task_index - c->finished_task_index + c->max_tasks) % c->max_tasks <= avctx->thread_count)) {
-            pthread_mutex_unlock(&c->finished_task_mutex);
-            return 0;
+    do {
+        outtask = &c->tasks[c->finished_task_index];
+        pthread_mutex_lock(&c->finished_task_mutex);
+        /* The access to task_index in the following code is ok,
+         * because it is only ever changed by the main thread. */
+        if (c->task_index == c->finished_task_index ||
+            (frame && !outtask->finished &&
+             (c->task_index - c->finished_task_index + c->max_tasks) % c->max_tasks <= avctx->thread_count)) {
+                pthread_mutex_unlock(&c->finished_task_mutex);
+                return 0;
+            }
+        while (!outtask->finished) {
+            pthread_cond_wait(&c->finished_task_cond, &c->finished_task_mutex);
         }
-    while (!outtask->finished) {
-        pthread_cond_wait(&c->finished_task_cond, &c->finished_task_mutex);
-    }
-    pthread_mutex_unlock(&c->finished_task_mutex);
-    /* We now own outtask completely: No worker thread touches it any more,
-     * because there is no outstanding task with this index. */
-    outtask->finished = 0;
-    av_packet_move_ref(pkt, outtask->outdata);
-    *got_packet_ptr = outtask->got_packet;
-    c->finished_task_index = (c->finished_task_index + 1) % c->max_tasks;
-
-    return outtask->return_code;
+        pthread_mutex_unlock(&c->finished_task_mutex);
+        /* We now own outtask completely: No worker thread touches it any more,
+         * because there is no outstanding task with this index. */
+        ret = outtask->return_code;
+        if (ret >= 0 && outtask->next_packet < outtask->nb_packets) {
+            av_packet_move_ref(pkt, outtask->outdata[outtask->next_packet++]);
+            *got_packet_ptr = 1;
+        }
+        if (ret < 0 || outtask->next_packet == outtask->nb_packets) {
+            for (unsigned i = 0; i < outtask->nb_frames; i++)
+                av_frame_unref(outtask->indata[i]);
+            for (unsigned i = outtask->next_packet; i < outtask->nb_packets; i++)
+                av_packet_unref(outtask->outdata[i]);
+            outtask->nb_frames   = 0;
+            outtask->nb_packets  = 0;
+            outtask->next_packet = 0;
+            outtask->finished    = 0;
+            c->finished_task_index = (c->finished_task_index + 1) % c->max_tasks;
+        }
+    } while (ret >= 0 && !*got_packet_ptr);
+
+    return ret;
 }
@@ -33,22 +33,18 @@
 
 #include "hevc/hevc.h"
 
-int ff_h2645_extract_rbsp(const uint8_t *src, int length,
-                          H2645RBSP *rbsp, H2645NAL *nal, int small_padding)
+/**
+ * Find the first 0x00 0x00 0x0N sequence with 1 <= N <= 3, that is an escape
+ * or a start code, starting at or after i.
+ *
+ * @return its position, or length if there is none
+ */
+static av_always_inline int find_escape(const uint8_t *src, int i, int length)
 {
-    int i, si, di;
-    uint8_t *dst;
-
-    nal->skipped_bytes = 0;
-#define STARTCODE_TEST                                                  \
+#define ESCAPE_TEST                                                     \
         if (i + 2 < length && src[i + 1] == 0 &&                        \
-           (src[i + 2] == 3 || src[i + 2] == 1)) {                      \
-            if (src[i + 2] == 1) {                                      \
-                /* startcode, so we must be past the end */             \
-                length = i;                                             \
-            }                                                           \
-            break;                                                      \
-        }
+            src[i + 2] && src[i + 2] <= 3)                              \
+            return i;
 #if HAVE_FAST_UNALIGNED
 #define FIND_FIRST_ZERO                                                 \
         if (i > 0 && !src[i])                                           \
@@ -56,87 +52,103 @@ int ff_h2645_extract_rbsp(const uint8_t *src, int length,
         while (src[i])                                                  \
             i++
 #if HAVE_FAST_64BIT
-    for (i = 0; i + 1 < length; i += 9) {
+    for (; i + 1 < length; i += 9) {
         if (!((~AV_RN64(src + i) &
                (AV_RN64(src + i) - 0x0100010001000101ULL)) &
               0x8000800080008080ULL))
             continue;
         FIND_FIRST_ZERO;
-        STARTCODE_TEST;
+        ESCAPE_TEST;
         i -= 7;
     }
 #else
-    for (i = 0; i + 1 < length; i += 5) {
+    for (; i + 1 < length; i += 5) {
         if (!((~AV_RN32(src + i) &
                (AV_RN32(src + i) - 0x01000101U)) &
               0x80008080U))
             continue;
         FIND_FIRST_ZERO;
-        STARTCODE_TEST;
+        ESCAPE_TEST;
         i -= 3;
     }
 #endif /* HAVE_FAST_64BIT */
+#undef FIND_FIRST_ZERO
 #else
-    for (i = 0; i + 1 < length; i += 2) {
+    for (; i + 1 < length; i += 2) {
         if (src[i])
             continue;
         if (i > 0 && src[i - 1] == 0)
             i--;
-        STARTCODE_TEST;
+        ESCAPE_TEST;
     }
 #endif /* HAVE_FAST_UNALIGNED */
+#undef ESCAPE_TEST
 
-    if (i >= length - 1 && small_padding) { // no escaped 0
+    return length;
+}
+
+int ff_h2645_extract_rbsp(const uint8_t *src, int length,
+                          H2645RBSP *rbsp, H2645NAL *nal, int small_padding)
+{
+    int i, si, di;
+    uint8_t *dst;
+
+    nal->skipped_bytes = 0;
+
+    /* 0x000002 is invalid but only ends the NAL after an escape */
+    i = find_escape(src, 0, length);
+    while (i < length && src[i + 2] == 2)
+        i = find_escape(src, i + 3, length);
+    if (i < length && src[i + 2] == 1) {
+        /* startcode, so we must be past the end */
+        length = i;
+    }
+
+    if (i >= length && small_padding) { // no escaped 0
         nal->data     =
         nal->raw_data = src;
         nal->size     =
         nal->raw_size = length;
         return length;
-    } else if (i > length)
-        i = length;
+    }
 
     dst = &rbsp->rbsp_buffer[rbsp->rbsp_buffer_size];
 
-    memcpy(dst, src, i);
-    si = di = i;
-    while (si + 2 < length) {
-        // remove escapes (very rare 1:2^22)
-        if (src[si + 2] > 3) {
-            dst[di++] = src[si++];
-            dst[di++] = src[si++];
-        } else if (src[si] == 0 && src[si + 1] == 0 && src[si + 2] != 0) {
-            if (src[si + 2] == 3) { // escape
-                dst[di++] = 0;
-                dst[di++] = 0;
-                si       += 3;
-
-                if (nal->skipped_bytes_pos) {
-                    nal->skipped_bytes++;
-                    if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
-                        nal->skipped_bytes_pos_size *= 2;
-                        av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
-                        av_reallocp_array(&nal->skipped_bytes_pos,
-                                nal->skipped_bytes_pos_size,
-                                sizeof(*nal->skipped_bytes_pos));
-                        if (!nal->skipped_bytes_pos) {
-                            nal->skipped_bytes_pos_size = 0;
-                            return AVERROR(ENOMEM);
-                        }
-                    }
-                    if (nal->skipped_bytes_pos)
-                        nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
+    si = di = 0;
+    while (i < length) {
+        // remove escapes (very rare 1:2^22), copying the data in between
+        // as a whole
+        memcpy(dst + di, src + si, i - si);
+        di      += i - si;
+        dst[di++] = 0;
+        dst[di++] = 0;
+        si       = i + 3;
+
+        if (nal->skipped_bytes_pos) {
+            nal->skipped_bytes++;
+            if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
+                nal->skipped_bytes_pos_size *= 2;
+                av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
+                av_reallocp_array(&nal->skipped_bytes_pos,
+                        nal->skipped_bytes_pos_size,
+                        sizeof(*nal->skipped_bytes_pos));
+                if (!nal->skipped_bytes_pos) {
+                    nal->skipped_bytes_pos_size = 0;
+                    return AVERROR(ENOMEM);
                 }
-                continue;
-            } else // next start code
-                goto nsc;
+            }
+            if (nal->skipped_bytes_pos)
+                nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
         }
 
-        dst[di++] = src[si++];
+        i = find_escape(src, si, length);
+        if (i < length && src[i + 2] != 3) // next start code
+            length = i;
     }
-    while (si < length)
-        dst[di++] = src[si++];
+    memcpy(dst + di, src + si, length - si);
+    di += length - si;
+    si  = length;
 
-nsc:
     memset(dst + di, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
     nal->data = dst;
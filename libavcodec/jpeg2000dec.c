@@ -1892,6 +1892,42 @@ static inline void roi_scale_cblk(Jpeg2000Cblk *cblk,
     }
 }
 
+/* decode and dequantize a code-block, returns whether it contained data */
+static int decode_cblk_dequant(const Jpeg2000DecoderContext *s,
+                               Jpeg2000T1Context *t1, Jpeg2000Component *comp,
+                               Jpeg2000CodingStyle *codsty, Jpeg2000Band *band,
+                               Jpeg2000Cblk *cblk, int bandpos, int magp)
+{
+    int x, y, ret;
+
+    if (codsty->cblk_style & JPEG2000_CTSY_HTJ2K_F)
+        ret = ff_jpeg2000_decode_htj2k(s, codsty, t1, cblk,
+                                       cblk->coord[0][1] - cblk->coord[0][0],
+                                       cblk->coord[1][1] - cblk->coord[1][0],
+                                       magp, comp->roi_shift);
+    else
+        ret = decode_cblk(s, codsty, t1, cblk,
+                          cblk->coord[0][1] - cblk->coord[0][0],
+                          cblk->coord[1][1] - cblk->coord[1][0],
+                          bandpos, comp->roi_shift);
+
+    if (!ret)
+        return 0;
+    x = cblk->coord[0][0] - band->coord[0][0];
+    y = cblk->coord[1][0] - band->coord[1][0];
+
+    if (comp->roi_shift)
+        roi_scale_cblk(cblk, comp, t1);
+    if (codsty->transform == FF_DWT97)
+        dequantization_float(x, y, cblk, comp, t1, band);
+    else if (codsty->transform == FF_DWT97_INT)
+        dequantization_int_97(x, y, cblk, comp, t1, band);
+    else
+        dequantization_int(x, y, cblk, comp, t1, band);
+
+    return 1;
+}
+
 static inline int tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile *tile)
 {
     Jpeg2000T1Context t1;
@@ -1940,36 +1976,10 @@ static inline int tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile
                     for (cblkno = 0;
                          cblkno < prec->nb_codeblocks_width * prec->nb_codeblocks_height;
                          cblkno++) {
-                        int x, y, ret;
-
                         Jpeg2000Cblk *cblk = prec->cblk + cblkno;
 
-                        if (codsty->cblk_style & JPEG2000_CTSY_HTJ2K_F)
-                            ret = ff_jpeg2000_decode_htj2k(s, codsty, &t1, cblk,
-                                                           cblk->coord[0][1] - cblk->coord[0][0],
-                                                           cblk->coord[1][1] - cblk->coord[1][0],
-                                                           magp, comp->roi_shift);
-                        else
-                            ret = decode_cblk(s, codsty, &t1, cblk,
-                                              cblk->coord[0][1] - cblk->coord[0][0],
-                                              cblk->coord[1][1] - cblk->coord[1][0],
-                                              bandpos, comp->roi_shift);
-
-                        if (ret)
-                            coded = 1;
-                        else
-                            continue;
-                        x = cblk->coord[0][0] - band->coord[0][0];
-                        y = cblk->coord[1][0] - band->coord[1][0];
-
-                        if (comp->roi_shift)
-                            roi_scale_cblk(cblk, comp, &t1);
-                        if (codsty->transform == FF_DWT97)
-                            dequantization_float(x, y, cblk, comp, &t1, band);
-                        else if (codsty->transform == FF_DWT97_INT)
-                            dequantization_int_97(x, y, cblk, comp, &t1, band);
-                        else
-                            dequantization_int(x, y, cblk, comp, &t1, band);
+                        coded |= decode_cblk_dequant(s, &t1, comp, codsty, band,
+                                                     cblk, bandpos, magp);
                    } /* end cblk */
                 } /*end prec */
             } /* end band */
@@ -1983,6 +1993,106 @@ static inline int tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile
     return 0;
 }
 
+/* List the code-blocks of a tile, to be decoded in parallel by
+ * decode_cblk_job() when there are fewer tiles than threads. */
+static int tile_cblk_jobs(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile)
+{
+    for (int compno = 0; compno < s->ncomponents; compno++) {
+        Jpeg2000Component *comp      = tile->comp   + compno;
+        Jpeg2000CodingStyle *codsty  = tile->codsty + compno;
+        Jpeg2000QuantStyle *quantsty = tile->qntsty + compno;
+        int subbandno = 0;
+
+        tile->coded[compno] = 0;
+
+        for (int reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
+            Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
+            int nb_precincts = rlevel->num_precincts_x * rlevel->num_precincts_y;
+
+            for (int bandno = 0; bandno < rlevel->nbands; bandno++, subbandno++) {
+                Jpeg2000Band *band = rlevel->band + bandno;
+                int magp = quantsty->expn[subbandno] + quantsty->nguardbits - 1;
+
+                if (band->coord[0][0] == band->coord[0][1] ||
+                    band->coord[1][0] == band->coord[1][1])
+                    continue;
+
+                if ((codsty->cblk_style & JPEG2000_CTSY_HTJ2K_F) && magp >= 31)
+                    return AVERROR_PATCHWELCOME;
+
+                for (int precno = 0; precno < nb_precincts; precno++) {
+                    Jpeg2000Prec *prec = band->prec + precno;
+                    int nb_cblks = prec->nb_codeblocks_width * prec->nb_codeblocks_height;
+                    Jpeg2000CblkJob *jobs;
+
+                    if (nb_cblks > INT_MAX / sizeof(*jobs) - s->nb_cblk_jobs)
+                        return AVERROR(ENOMEM);
+                    jobs = av_fast_realloc(s->cblk_jobs, &s->cblk_jobs_size,
+                                           (s->nb_cblk_jobs + nb_cblks) * sizeof(*jobs));
+                    if (!jobs)
+                        return AVERROR(ENOMEM);
+                    s->cblk_jobs = jobs;
+
+                    for (int cblkno = 0; cblkno < nb_cblks; cblkno++) {
+                        Jpeg2000CblkJob *job = &jobs[s->nb_cblk_jobs++];
+
+                        job->tile    = tile;
+                        job->band    = band;
+                        job->cblk    = prec->cblk + cblkno;
+                        job->compno  = compno;
+                        job->bandpos = bandno + (reslevelno > 0);
+                        job->magp    = magp;
+                        job->coded   = 0;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int decode_cblk_job(AVCodecContext *avctx, void *td,
+                           int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    Jpeg2000CblkJob *job = s->cblk_jobs + jobnr;
+    Jpeg2000CodingStyle *codsty = job->tile->codsty + job->compno;
+    Jpeg2000T1Context t1;
+
+    t1.stride  = (1 << codsty->log2_cblk_width) + 2;
+    job->coded = decode_cblk_dequant(s, &t1, job->tile->comp + job->compno,
+                                     codsty, job->band, job->cblk,
+                                     job->bandpos, job->magp);
+    return 0;
+}
+
+/* With fewer tiles than threads, decode the code-blocks of all tiles in
+ * parallel, leaving only the inverse transforms to the tile threads. */
+static void decode_cblks(Jpeg2000DecoderContext *s)
+{
+    const int nb_tiles = s->numXtiles * s->numYtiles;
+
+    s->nb_cblk_jobs = 0;
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        nb_tiles >= s->avctx->thread_count)
+        return;
+
+    for (int tileno = 0; tileno < nb_tiles; tileno++) {
+        if (tile_cblk_jobs(s, s->tile + tileno) < 0) {
+            /* let tile_codeblocks() report the error */
+            s->nb_cblk_jobs = 0;
+            return;
+        }
+    }
+
+    s->avctx->execute2(s->avctx, decode_cblk_job, NULL, NULL, s->nb_cblk_jobs);
+
+    for (int i = 0; i < s->nb_cblk_jobs; i++) {
+        const Jpeg2000CblkJob *job = &s->cblk_jobs[i];
+        job->tile->coded[job->compno] |= job->coded;
+    }
+}
+
 #define WRITE_FRAME(D, PIXEL)                                                                     \
     static inline void write_frame_ ## D(const Jpeg2000DecoderContext * s, Jpeg2000Tile * tile,   \
                                          AVFrame * picture, int precision)                        \
@@ -2057,9 +2167,19 @@ static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
     AVFrame *picture = td;
     Jpeg2000Tile *tile = s->tile + jobnr;
 
-    int ret = tile_codeblocks(s, tile);
-    if (ret < 0)
-        return ret;
+    if (s->nb_cblk_jobs) {
+        for (int compno = 0; compno < s->ncomponents; compno++) {
+            Jpeg2000Component *comp     = tile->comp   + compno;
+            Jpeg2000CodingStyle *codsty = tile->codsty + compno;
+
+            if (tile->coded[compno])
+                ff_dwt_decode(&comp->dwt, codsty->transform == FF_DWT97 ? (void*)comp->f_data : (void*)comp->i_data);
+        }
+    } else {
+        int ret = tile_codeblocks(s, tile);
+        if (ret < 0)
+            return ret;
+    }
 
     /* inverse MCT transformation */
     if (tile->codsty[0].mct)
@@ -2440,6 +2560,16 @@ static int jp2_find_codestream(Jpeg2000DecoderContext *s)
     return 0;
 }
 
+static av_cold int jpeg2000_decode_close(AVCodecContext *avctx)
+{
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+
+    av_freep(&s->cblk_jobs);
+    s->cblk_jobs_size = 0;
+
+    return 0;
+}
+
 static av_cold int jpeg2000_decode_init(AVCodecContext *avctx)
 {
     Jpeg2000DecoderContext *s = avctx->priv_data;
@@ -2527,6 +2657,7 @@ static int jpeg2000_decode_frame(AVCodecContext *avctx, AVFrame *picture,
         }
     }
 
+    decode_cblks(s);
     avctx->execute2(avctx, jpeg2000_decode_tile, picture, NULL, s->numXtiles * s->numYtiles);
 
     jpeg2000_dec_cleanup(s);
@@ -2567,6 +2698,7 @@ const FFCodec ff_jpeg2000_decoder = {
     .p.capabilities   = AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_DR1,
     .priv_data_size   = sizeof(Jpeg2000DecoderContext),
     .init             = jpeg2000_decode_init,
+    .close            = jpeg2000_decode_close,
     FF_CODEC_DECODE_CB(jpeg2000_decode_frame),
     .p.priv_class     = &jpeg2000_class,
     .p.max_lowres     = 5,
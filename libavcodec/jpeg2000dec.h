@@ -68,8 +68,20 @@ typedef struct Jpeg2000Tile {
     GetByteContext      packed_headers_stream;  // byte context corresponding to packed headers
     uint16_t tp_idx;                    // Tile-part index
     int coord[2][2];                    // border coordinates {{x0, x1}, {y0, y1}}
+    uint8_t coded[4];                   // whether a component has coded data, with code-block threading
 } Jpeg2000Tile;
 
+/* a code-block to be decoded by a slice thread */
+typedef struct Jpeg2000CblkJob {
+    Jpeg2000Tile *tile;
+    Jpeg2000Band *band;
+    Jpeg2000Cblk *cblk;
+    int compno;
+    int bandpos;
+    int magp;
+    int coded;
+} Jpeg2000CblkJob;
+
 typedef struct Jpeg2000DecoderContext {
     AVClass         *class;
     AVCodecContext  *avctx;
@@ -112,6 +124,10 @@ typedef struct Jpeg2000DecoderContext {
     Jpeg2000Tile    *tile;
     Jpeg2000DSPContext dsp;
 
+    Jpeg2000CblkJob *cblk_jobs;
+    unsigned int    cblk_jobs_size;
+    int             nb_cblk_jobs;
+
     /*options parameters*/
     int             reduction_factor;
 } Jpeg2000DecoderContext;
@@ -30,6 +30,8 @@
  * MJPEG decoder.
  */
 
+#include <stdatomic.h>
+
 #include "config_components.h"
 
 #include "libavutil/display.h"
@@ -813,10 +815,11 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
     return 0;
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0 || code > 16) {
         av_log(s->avctx, AV_LOG_WARNING,
                "mjpeg_decode_dc: bad vlc: %d:%d (%p)\n",
@@ -825,47 +828,48 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
     }
 
     if (code)
-        return get_xbits(&s->gb, code);
+        return get_xbits(gb, code);
     else
         return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb,
+                        int16_t *block, int *last_dc,
                         int dc_index, int ac_index, uint16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = val * (unsigned)quant_matrix[0] + s->last_dc[component];
+    val = val * (unsigned)quant_matrix[0] + *last_dc;
     val = av_clip_int16(val);
-    s->last_dc[component] = val;
+    *last_dc = val;
     block[0] = val;
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
         if (code) {
             if (code > MIN_CACHE_BITS - 16)
-                UPDATE_CACHE(re, &s->gb);
+                UPDATE_CACHE(re, gb);
 
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -875,7 +879,7 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[i];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
@@ -886,7 +890,7 @@ static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
 {
     unsigned val;
     s->bdsp.clear_block(block);
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, &s->gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
@@ -1180,7 +1184,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int nb_components, int p
                 topleft[i] = top[i];
                 top[i]     = buffer[mb_x][i];
 
-                dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                 if(dc == 0xFFFFF)
                     return -1;
 
@@ -1314,7 +1318,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for(j=0; j<n; j++) {
                         int pred, dc;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1385,7 +1389,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for (j = 0; j < n; j++) {
                         int pred;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1454,6 +1458,168 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
+typedef struct MJpegScanSliceArg {
+    uint8_t *data[MAX_COMPONENTS];
+    int linesize[MAX_COMPONENTS];
+    int nb_components;
+    int chroma_width, chroma_height;
+    int start;      ///< byte offset of the first restart interval
+    int end_bits;   ///< bit offset at which the last restart interval ended
+    atomic_int error;
+} MJpegScanSliceArg;
+
+static int decode_block_put(MJpegDecodeContext *s, GetBitContext *gb,
+                            int16_t *block, int *last_dc, int i,
+                            uint8_t *ptr, int linesize)
+{
+    s->bdsp.clear_block(block);
+    if (decode_block(s, gb, block, last_dc,
+                     s->dc_index[i], s->ac_index[i],
+                     s->quant_matrixes[s->quant_sindex[i]]) < 0)
+        return AVERROR_INVALIDDATA;
+    if (ptr && linesize) {
+        s->idsp.idct_put(ptr, linesize, block);
+        if (s->bits & 7)
+            shift_output(s, ptr, linesize);
+    }
+    return 0;
+}
+
+/* decode one restart interval of a sequential scan, the DC predictors are
+ * reset at every RSTn so all intervals are independent */
+static int decode_restart_interval(AVCodecContext *avctx, void *arg,
+                                   int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    MJpegScanSliceArg *sa = arg;
+    const int bytes_per_pixel = 1 + (s->bits > 8);
+    const int start  = jobnr ? s->rst_pos[jobnr - 1] + 2 : sa->start;
+    const int end    = jobnr < s->nb_rst ? s->rst_pos[jobnr] :
+                       (s->gb.buffer_end - s->gb.buffer);
+    const int mb_end = FFMIN((jobnr + 1) * s->restart_interval,
+                             s->mb_width * s->mb_height);
+    LOCAL_ALIGNED_32(int16_t, block, [64]);
+    int last_dc[MAX_COMPONENTS];
+    GetBitContext gb;
+    int ret;
+
+    ret = init_get_bits8(&gb, s->buffer + start, end - start);
+    if (ret < 0)
+        goto fail;
+
+    for (int i = 0; i < sa->nb_components; i++)
+        last_dc[i] = 4 << s->bits;
+
+    for (int mb = jobnr * s->restart_interval; mb < mb_end; mb++) {
+        const int mb_x = mb % s->mb_width;
+        const int mb_y = mb / s->mb_width;
+
+        if (get_bits_left(&gb) < 0) {
+            av_log(avctx, AV_LOG_ERROR, "overread %d\n", -get_bits_left(&gb));
+            ret = AVERROR_INVALIDDATA;
+            goto fail;
+        }
+        for (int i = 0; i < sa->nb_components; i++) {
+            int c = s->comp_index[i];
+            int h = s->h_scount[i];
+            int v = s->v_scount[i];
+            int x = 0, y = 0;
+
+            for (int j = 0; j < s->nb_blocks[i]; j++) {
+                int block_offset = (((sa->linesize[c] * (v * mb_y + y) * 8) +
+                                     (h * mb_x + x) * 8 * bytes_per_pixel) >> avctx->lowres);
+                uint8_t *ptr = NULL;
+
+                if (s->interlaced && s->bottom_field)
+                    block_offset += sa->linesize[c] >> 1;
+                if (   8*(h * mb_x + x) < ((c == 1) || (c == 2) ? sa->chroma_width  : s->width)
+                    && 8*(v * mb_y + y) < ((c == 1) || (c == 2) ? sa->chroma_height : s->height))
+                    ptr = sa->data[c] + block_offset;
+
+                ret = decode_block_put(s, &gb, block, &last_dc[i], i,
+                                       ptr, sa->linesize[c]);
+                if (ret < 0) {
+                    av_log(avctx, AV_LOG_ERROR,
+                           "error y=%d x=%d\n", mb_y, mb_x);
+                    goto fail;
+                }
+                if (++x == h) {
+                    x = 0;
+                    y++;
+                }
+            }
+        }
+    }
+
+    if (jobnr == s->nb_rst)
+        sa->end_bits = start * 8 + get_bits_count(&gb);
+
+    return 0;
+fail:
+    atomic_store(&sa->error, ret);
+    return ret;
+}
+
+/* Check that the RSTn markers found while unescaping split the scan into
+ * exactly the expected restart intervals, in order. */
+static int restart_intervals_usable(MJpegDecodeContext *s)
+{
+    int nb_intervals, prev;
+
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        s->nb_rst <= 0 || !s->restart_interval || s->progressive ||
+        s->gb.buffer != s->buffer || get_bits_count(&s->gb) & 7)
+        return 0;
+
+    nb_intervals = (s->mb_width * s->mb_height + s->restart_interval - 1) /
+                   s->restart_interval;
+    if (s->nb_rst != nb_intervals - 1)
+        return 0;
+
+    prev = get_bits_count(&s->gb) >> 3;
+    for (int k = 0; k < s->nb_rst; k++) {
+        int pos = s->rst_pos[k];
+        if (pos < prev || pos + 2 > (s->gb.buffer_end - s->gb.buffer) ||
+            s->buffer[pos] != 0xFF || s->buffer[pos + 1] != RST0 + (k & 7))
+            return 0;
+        prev = pos + 2;
+    }
+
+    return 1;
+}
+
+static int mjpeg_decode_scan_slices(MJpegDecodeContext *s, int nb_components,
+                                    uint8_t *data[], const int linesize[],
+                                    int chroma_width, int chroma_height)
+{
+    MJpegScanSliceArg sa = {
+        .nb_components = nb_components,
+        .chroma_width  = chroma_width,
+        .chroma_height = chroma_height,
+        .start         = get_bits_count(&s->gb) >> 3,
+    };
+    int ret;
+
+    for (int i = 0; i < nb_components; i++) {
+        int c = s->comp_index[i];
+        sa.data[c]     = data[c];
+        sa.linesize[c] = linesize[c];
+    }
+    atomic_init(&sa.error, 0);
+
+    s->avctx->execute2(s->avctx, decode_restart_interval, &sa, NULL,
+                       s->nb_rst + 1);
+
+    ret = atomic_load(&sa.error);
+    if (ret < 0)
+        return ret;
+
+    /* leave the reader where the serial loop would have */
+    skip_bits_long(&s->gb, sa.end_bits - get_bits_count(&s->gb));
+
+    return 0;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              int mb_bitmask_size,
@@ -1489,6 +1655,10 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         s->coefs_finished[c] |= 1;
     }
 
+    if (!mb_bitmask && restart_intervals_usable(s))
+        return mjpeg_decode_scan_slices(s, nb_components, data, linesize,
+                                        chroma_width, chroma_height);
+
     for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
@@ -1528,20 +1698,12 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                                 mjpeg_copy_block(s, ptr, reference_data[c] + block_offset,
                                                 linesize[c], s->avctx->lowres);
 
-                        } else {
-                            s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
-                                             s->dc_index[i], s->ac_index[i],
-                                             s->quant_matrixes[s->quant_sindex[i]]) < 0) {
-                                av_log(s->avctx, AV_LOG_ERROR,
-                                       "error y=%d x=%d\n", mb_y, mb_x);
-                                return AVERROR_INVALIDDATA;
-                            }
-                            if (ptr && linesize[c]) {
-                                s->idsp.idct_put(ptr, linesize[c], s->block);
-                                if (s->bits & 7)
-                                    shift_output(s, ptr, linesize[c]);
-                            }
+                        } else if (decode_block_put(s, &s->gb, s->block,
+                                                    &s->last_dc[i], i,
+                                                    ptr, linesize[c]) < 0) {
+                            av_log(s->avctx, AV_LOG_ERROR,
+                                   "error y=%d x=%d\n", mb_y, mb_x);
+                            return AVERROR_INVALIDDATA;
                         }
                     } else {
                         int block_idx  = s->block_stride[c] * (v * mb_y + y) +
@@ -2261,6 +2423,8 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
             }                                         \
         } while (0)
 
+        s->nb_rst = 0;
+
         if (s->avctx->codec_id == AV_CODEC_ID_THP) {
             ptr = buf_end;
             copy_data_segment(0);
@@ -2289,6 +2453,16 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                         copy_data_segment(1);
                         if (x)
                             break;
+                    } else if (s->avctx->active_thread_type & FF_THREAD_SLICE &&
+                               s->nb_rst >= 0) {
+                        int *tmp = av_fast_realloc(s->rst_pos, &s->rst_pos_size,
+                                                   (s->nb_rst + 1) * sizeof(*s->rst_pos));
+                        if (tmp) {
+                            /* offset of the 0xFF preceding x once copied */
+                            tmp[s->nb_rst++] = (dst - s->buffer) + (ptr - src) - 2;
+                            s->rst_pos = tmp;
+                        } else
+                            s->nb_rst = -1;
                     }
                 }
             }
@@ -2951,6 +3125,7 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_frame_free(&s->smv_frame);
 
     av_freep(&s->buffer);
+    av_freep(&s->rst_pos);
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
@@ -3008,7 +3183,7 @@ const FFCodec ff_mjpeg_decoder = {
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_DECODE_CB(ff_mjpeg_decode_frame),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
@@ -123,6 +123,11 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    /* byte offsets of the RSTn markers in the unescaped scan data,
+     * only collected with slice threading; -1 if they could not be */
+    int *rst_pos;
+    unsigned int rst_pos_size;
+    int nb_rst;
 
     int buggy_avid;
     int cs_itu601;
@@ -1179,7 +1179,8 @@ av_cold void ff_mpeg1_encode_init(MpegEncContext *s)
       OFFSET(scan_offset),         AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, VE }, \
     { "timecode_frame_start", "GOP timecode frame start number, in non-drop-frame format", \
       OFFSET(timecode_frame_start), AV_OPT_TYPE_INT64, {.i64 = -1 }, -1, INT64_MAX, VE}, \
-    FF_MPV_COMMON_BFRAME_OPTS
+    FF_MPV_COMMON_BFRAME_OPTS                                                 \
+    FF_MPV_COMMON_GOP_THREADS_OPTS
 
 static const AVOption mpeg1_options[] = {
     COMMON_OPTS
@@ -1238,12 +1239,14 @@ const FFCodec ff_mpeg1video_encoder = {
     .init                 = encode_init,
     FF_CODEC_ENCODE_CB(ff_mpv_encode_picture),
     .close                = ff_mpv_encode_end,
+    .flush                = ff_mpv_encode_flush,
+    UPDATE_GOP_STATE(ff_mpv_encode_update_gop_state),
     .p.supported_framerates = ff_mpeg12_frame_rate_tab + 1,
     .p.pix_fmts           = (const enum AVPixelFormat[]) { AV_PIX_FMT_YUV420P,
                                                            AV_PIX_FMT_NONE },
     .p.capabilities       = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
                             AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
-    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP,
+    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_GOP_THREADS,
     .p.priv_class         = &mpeg1_class,
 };
 
@@ -1256,13 +1259,15 @@ const FFCodec ff_mpeg2video_encoder = {
     .init                 = encode_init,
     FF_CODEC_ENCODE_CB(ff_mpv_encode_picture),
     .close                = ff_mpv_encode_end,
+    .flush                = ff_mpv_encode_flush,
+    UPDATE_GOP_STATE(ff_mpv_encode_update_gop_state),
     .p.supported_framerates = ff_mpeg2_frame_rate_tab,
     .p.pix_fmts           = (const enum AVPixelFormat[]) { AV_PIX_FMT_YUV420P,
                                                            AV_PIX_FMT_YUV422P,
                                                            AV_PIX_FMT_NONE },
     .p.capabilities       = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
                             AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
-    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP,
+    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_GOP_THREADS,
     .p.priv_class         = &mpeg2_class,
 };
 #endif /* CONFIG_MPEG1VIDEO_ENCODER || CONFIG_MPEG2VIDEO_ENCODER */
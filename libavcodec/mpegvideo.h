@@ -552,6 +552,8 @@ typedef struct MpegEncContext {
     int noise_reduction;
 
     int intra_penalty;
+
+    int gop_threads;    ///< code closed GOPs in parallel, see FF_CODEC_CAP_GOP_THREADS
 } MpegEncContext;
 
 
@@ -1082,6 +1082,70 @@ av_cold int ff_mpv_encode_end(AVCodecContext *avctx)
     return 0;
 }
 
+/**
+ * Restart the encoder to code a new closed GOP of the stream, as if it had
+ * just been opened, except for the rate control state.
+ * Used for FF_CODEC_CAP_GOP_THREADS, the encoder must have been drained.
+ */
+void ff_mpv_encode_flush(AVCodecContext *avctx)
+{
+    MpegEncContext *s = avctx->priv_data;
+    size_t mv_table_size = (s->mb_height + 2) * s->mb_stride + 1;
+
+    for (int i = 0; i < MAX_B_FRAMES + 1; i++) {
+        ff_refstruct_unref(&s->input_picture[i]);
+        ff_refstruct_unref(&s->reordered_input_picture[i]);
+    }
+    ff_mpv_unref_picture(&s->cur_pic);
+    ff_mpv_unref_picture(&s->last_pic);
+    ff_mpv_unref_picture(&s->next_pic);
+    av_frame_unref(s->new_pic);
+
+    s->picture_number        = 0;
+    s->input_picture_number  = 0;
+    s->coded_picture_number  = 0;
+    s->picture_in_gop_number = 0;
+    s->user_specified_pts    = AV_NOPTS_VALUE;
+    s->last_pict_type        = 0;
+    s->last_non_b_pict_type  = 0;
+    memset(s->last_lambda_for, 0, sizeof(s->last_lambda_for));
+
+    /* The motion estimation uses the vector ranges and the vectors of the
+     * previous pictures. */
+    s->f_code = 1;
+    s->b_code = 1;
+#define CLEAR_MV_TABLE(table, n)                                            \
+    if (s->table)                                                           \
+        memset(s->table, 0, (n) * mv_table_size * sizeof(*s->table))
+    CLEAR_MV_TABLE(p_mv_table_base,            1);
+    CLEAR_MV_TABLE(b_forw_mv_table_base,       1);
+    CLEAR_MV_TABLE(b_back_mv_table_base,       1);
+    CLEAR_MV_TABLE(b_bidir_forw_mv_table_base, 1);
+    CLEAR_MV_TABLE(b_bidir_back_mv_table_base, 1);
+    CLEAR_MV_TABLE(b_direct_mv_table_base,     1);
+    CLEAR_MV_TABLE(p_field_mv_table_base,      4);
+    CLEAR_MV_TABLE(b_field_mv_table_base,      8);
+#undef CLEAR_MV_TABLE
+
+    ff_rate_control_restart(s);
+}
+
+/**
+ * Continue the rate control of src in dst.
+ * Used for FF_CODEC_CAP_GOP_THREADS.
+ */
+int ff_mpv_encode_update_gop_state(AVCodecContext *dst,
+                                   const AVCodecContext *src)
+{
+    MpegEncContext *const s1 = src->priv_data;
+    MpegEncContext *const s  = dst->priv_data;
+
+    if (dst != src)
+        ff_rate_control_copy_state(s, s1);
+
+    return 0;
+}
+
 #define IS_ENCODER 1
 #include "mpv_reconstruct_mb_template.c"
 
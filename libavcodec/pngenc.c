@@ -42,6 +42,12 @@
 
 #define IOBUF_SIZE 4096
 
+/* amount of filtered image data deflated as one independent slice
+ * with slice threading */
+#define SLICE_SIZE  (128 * 1024)
+/* size of the deflate window, primed with the data preceding a slice */
+#define WINDOW_SIZE (1 << MAX_WBITS)
+
 typedef struct APNGFctlChunk {
     uint32_t sequence_number;
     uint32_t width, height;
@@ -50,6 +56,24 @@ typedef struct APNGFctlChunk {
     uint8_t dispose_op, blend_op;
 } APNGFctlChunk;
 
+typedef struct PNGEncSlice {
+    FFZStream zstream;      ///< raw deflate stream
+
+    uint8_t *crow_base;
+    unsigned crow_size;
+    uint8_t *window;        ///< filtered rows preceding the slice
+    unsigned window_size;
+
+    uint8_t *buf;           ///< compressed data, starting at buf + 2
+    unsigned buf_size;
+    int len;                ///< length of the compressed data
+
+    int start;              ///< first row of the slice
+    uLong adler;            ///< Adler-32 of the uncompressed slice data
+    size_t in_len;          ///< length of the uncompressed slice data
+    int ret;
+} PNGEncSlice;
+
 typedef struct PNGEncContext {
     AVClass *class;
     LLVidEncDSPContext llvidencdsp;
@@ -62,6 +86,12 @@ typedef struct PNGEncContext {
 
     FFZStream zstream;
     uint8_t buf[IOBUF_SIZE];
+
+    PNGEncSlice *slices;         ///< one per thread with slice threading
+    int nb_slices;
+    int rows_per_slice;
+    uint16_t zlib_header;
+
     int dpi;                     ///< Physical pixel density, in dots per inch, if set
     int dpm;                     ///< Physical pixel density, in dots per meter, if set
 
@@ -505,6 +535,148 @@ static int encode_headers(AVCodecContext *avctx, const AVFrame *pict)
     return 0;
 }
 
+static int encode_slice(PNGEncContext *s, PNGEncSlice *sl, const AVFrame *p)
+{
+    z_stream *const zstream = &sl->zstream.zstream;
+    const int row_size = (p->width * s->bits_per_pixel + 7) >> 3;
+    const int bpp      = s->bits_per_pixel >> 3;
+    const int start    = sl->start;
+    const int end      = FFMIN(start + s->rows_per_slice, p->height);
+    const uint8_t *top = NULL;
+    uint8_t *crow_buf, *crow;
+    int y, ret;
+
+    av_fast_malloc(&sl->crow_base, &sl->crow_size,
+                   (row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
+    av_fast_malloc(&sl->buf, &sl->buf_size,
+                   deflateBound(zstream, (end - start) * (row_size + 1)) + 2 + 16 + 4);
+    if (!sl->crow_base || !sl->buf)
+        return AVERROR(ENOMEM);
+    // pixel data should be aligned, but there's a control byte before it
+    crow_buf = sl->crow_base + 15;
+
+    deflateReset(zstream);
+
+    /* Prime the window with the rows preceding the slice, so that matches
+     * across the slice boundary are still found, as with a single stream. */
+    if (start) {
+        int nb_rows = FFMIN(start, (WINDOW_SIZE + row_size) / (row_size + 1));
+        int size    = nb_rows * (row_size + 1);
+        uint8_t *dst;
+
+        av_fast_malloc(&sl->window, &sl->window_size, size);
+        if (!sl->window)
+            return AVERROR(ENOMEM);
+
+        dst = sl->window;
+        y   = start - nb_rows;
+        top = y ? p->data[0] + (y - 1) * p->linesize[0] : NULL;
+        for (; y < start; y++) {
+            const uint8_t *ptr = p->data[0] + y * p->linesize[0];
+            crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bpp);
+            memcpy(dst, crow, row_size + 1);
+            dst += row_size + 1;
+            top = ptr;
+        }
+
+        if (size > WINDOW_SIZE)
+            ret = deflateSetDictionary(zstream, dst - WINDOW_SIZE, WINDOW_SIZE);
+        else
+            ret = deflateSetDictionary(zstream, sl->window, size);
+        if (ret != Z_OK)
+            return AVERROR_EXTERNAL;
+    }
+
+    zstream->next_out  = sl->buf + 2;
+    zstream->avail_out = sl->buf_size - 2 - 4;
+    sl->adler = adler32(0, NULL, 0);
+
+    for (y = start; y < end; y++) {
+        const uint8_t *ptr = p->data[0] + y * p->linesize[0];
+        crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bpp);
+        sl->adler = adler32(sl->adler, crow, row_size + 1);
+
+        zstream->next_in  = crow;
+        zstream->avail_in = row_size + 1;
+        ret = deflate(zstream, Z_NO_FLUSH);
+        if (ret != Z_OK || zstream->avail_in)
+            return AVERROR_EXTERNAL;
+        top = ptr;
+    }
+
+    /* the last slice terminates the stream, the others end on a byte
+     * boundary with an empty stored block, so that they can be concatenated */
+    ret = deflate(zstream, end == p->height ? Z_FINISH : Z_SYNC_FLUSH);
+    if (ret != (end == p->height ? Z_STREAM_END : Z_OK))
+        return AVERROR_EXTERNAL;
+
+    sl->len    = zstream->next_out - (sl->buf + 2);
+    sl->in_len = (end - start) * (row_size + 1);
+
+    return 0;
+}
+
+static int encode_slice_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s = avctx->priv_data;
+    PNGEncSlice *sl  = &s->slices[jobnr];
+
+    sl->ret = encode_slice(s, sl, arg);
+    return 0;
+}
+
+/**
+ * Filter and deflate the image in independent slices of rows in parallel and
+ * concatenate them into a single zlib stream, as pigz does.
+ */
+static int encode_frame_slices(AVCodecContext *avctx, const AVFrame *pict)
+{
+    PNGEncContext *s = avctx->priv_data;
+    const int row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
+    uLong adler = adler32(0, NULL, 0);
+    int y = 0;
+
+    s->rows_per_slice = FFMAX(SLICE_SIZE / (row_size + 1), 1);
+
+    while (y < pict->height) {
+        int nb_jobs = FFMIN((pict->height - y + s->rows_per_slice - 1) / s->rows_per_slice,
+                            s->nb_slices);
+
+        for (int i = 0; i < nb_jobs; i++)
+            s->slices[i].start = y + i * s->rows_per_slice;
+
+        avctx->execute2(avctx, encode_slice_thread, (void *)pict, NULL, nb_jobs);
+
+        for (int i = 0; i < nb_jobs; i++) {
+            PNGEncSlice *sl = &s->slices[i];
+            uint8_t *buf = sl->buf + 2;
+            int len      = sl->len;
+
+            if (sl->ret < 0)
+                return sl->ret;
+
+            adler = adler32_combine(adler, sl->adler, sl->in_len);
+
+            if (!y && !i) {
+                AV_WB16(sl->buf, s->zlib_header);
+                buf -= 2;
+                len += 2;
+            }
+            y = FFMIN(y + s->rows_per_slice, pict->height);
+            if (y == pict->height) {
+                AV_WB32(buf + len, adler);
+                len += 4;
+            }
+
+            if (s->bytestream_end - s->bytestream < len + 16 + 100)
+                return AVERROR_BUG;
+            png_write_image_data(avctx, buf, len);
+        }
+    }
+
+    return 0;
+}
+
 static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
 {
     PNGEncContext *s       = avctx->priv_data;
@@ -517,6 +689,9 @@ static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
     uint8_t *progressive_buf = NULL;
     uint8_t *top_buf         = NULL;
 
+    if (s->nb_slices && !s->is_progressive)
+        return encode_frame_slices(avctx, pict);
+
     row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
 
     crow_base = av_malloc((row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
@@ -1183,6 +1358,28 @@ static av_cold int png_enc_init(AVCodecContext *avctx)
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT
                       ? Z_DEFAULT_COMPRESSION
                       : av_clip(avctx->compression_level, 0, 9);
+
+    if (avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1) {
+        int flevel = compression_level == Z_DEFAULT_COMPRESSION ? 2 :
+                     compression_level < 2 ? 0 :
+                     compression_level < 6 ? 1 :
+                     compression_level == 6 ? 2 : 3;
+
+        /* the header deflate() would write for this level, see RFC 1950 */
+        s->zlib_header  = 0x7800 | flevel << 6;
+        s->zlib_header += 31 - s->zlib_header % 31;
+
+        s->slices = av_calloc(avctx->thread_count, sizeof(*s->slices));
+        if (!s->slices)
+            return AVERROR(ENOMEM);
+        for (; s->nb_slices < avctx->thread_count; s->nb_slices++) {
+            int ret = ff_deflate_init2(&s->slices[s->nb_slices].zstream,
+                                       compression_level, -MAX_WBITS, avctx);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
     return ff_deflate_init(&s->zstream, compression_level, avctx);
 }
 
@@ -1191,6 +1388,16 @@ static av_cold int png_enc_close(AVCodecContext *avctx)
     PNGEncContext *s = avctx->priv_data;
 
     ff_deflate_end(&s->zstream);
+    for (int i = 0; i < s->nb_slices; i++) {
+        PNGEncSlice *sl = &s->slices[i];
+
+        ff_deflate_end(&sl->zstream);
+        av_freep(&sl->crow_base);
+        av_freep(&sl->window);
+        av_freep(&sl->buf);
+    }
+    av_freep(&s->slices);
+    s->nb_slices = 0;
     av_frame_free(&s->last_frame);
     av_frame_free(&s->prev_frame);
     av_freep(&s->last_frame_packet);
@@ -1227,6 +1434,7 @@ const FFCodec ff_png_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_PNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
@@ -1250,6 +1458,7 @@ const FFCodec ff_apng_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_APNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
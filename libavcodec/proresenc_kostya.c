@@ -219,11 +219,16 @@ struct TrellisNode {
 
 #define MAX_STORED_Q 16
 
+/* (x * QUANT_RECIP(q)) >> 32 == x / q for 0 <= x < 65536 and 2 <= q < 65536 */
+#define QUANT_RECIP(q) (0xFFFFFFFFU / (q) + 1)
+
 typedef struct ProresThreadData {
     DECLARE_ALIGNED(16, int16_t, blocks)[MAX_PLANES][64 * 4 * MAX_MBS_PER_SLICE];
     DECLARE_ALIGNED(16, uint16_t, emu_buf)[16 * 16];
     int16_t custom_q[64];
     int16_t custom_chroma_q[64];
+    uint32_t custom_q_recip[64];
+    uint32_t custom_chroma_q_recip[64];
     struct TrellisNode *nodes;
 } ProresThreadData;
 
@@ -233,6 +238,8 @@ typedef struct ProresContext {
     DECLARE_ALIGNED(16, uint16_t, emu_buf)[16*16];
     int16_t quants[MAX_STORED_Q][64];
     int16_t quants_chroma[MAX_STORED_Q][64];
+    uint32_t quants_recip[MAX_STORED_Q][64];
+    uint32_t quants_chroma_recip[MAX_STORED_Q][64];
     int16_t custom_q[64];
     int16_t custom_chroma_q[64];
     const uint8_t *quant_mat;
@@ -664,24 +671,31 @@ static int estimate_dcs(int *error, int16_t *blocks, int blocks_per_slice,
 }
 
 static int estimate_acs(int *error, int16_t *blocks, int blocks_per_slice,
-                        const uint8_t *scan, const int16_t *qmat)
+                        const uint8_t *scan, const int16_t *qmat,
+                        const uint32_t *qrecip)
 {
     int idx, i;
     int prev_run = 4;
     int prev_level = 2;
-    int run, level;
-    int max_coeffs, abs_level;
+    int run;
+    int max_coeffs;
+    unsigned abs_val, abs_level;
     int bits = 0;
 
     max_coeffs = blocks_per_slice << 6;
     run        = 0;
 
     for (i = 1; i < 64; i++) {
+        const unsigned quant = qmat[scan[i]];
+        const uint32_t recip = qrecip[scan[i]];
+
         for (idx = scan[i]; idx < max_coeffs; idx += 64) {
-            level   = blocks[idx] / qmat[scan[i]];
-            *error += FFABS(blocks[idx]) % qmat[scan[i]];
-            if (level) {
-                abs_level = FFABS(level);
+            /* the division by the quantiser is the bottleneck of the
+             * quantiser search, multiply by its reciprocal instead */
+            abs_val   = FFABS(blocks[idx]);
+            abs_level = ((uint64_t)abs_val * recip) >> 32;
+            *error   += abs_val - abs_level * quant;
+            if (abs_level) {
                 bits += estimate_vlc(ff_prores_run_to_cb[prev_run], run);
                 bits += estimate_vlc(ff_prores_level_to_cb[prev_level],
                                      abs_level - 1) + 1;
@@ -702,7 +716,8 @@ static int estimate_slice_plane(ProresContext *ctx, int *error, int plane,
                                 const uint16_t *src, ptrdiff_t linesize,
                                 int mbs_per_slice,
                                 int blocks_per_mb,
-                                const int16_t *qmat, ProresThreadData *td)
+                                const int16_t *qmat, const uint32_t *qrecip,
+                                ProresThreadData *td)
 {
     int blocks_per_slice;
     int bits;
@@ -710,7 +725,8 @@ static int estimate_slice_plane(ProresContext *ctx, int *error, int plane,
     blocks_per_slice = mbs_per_slice * blocks_per_mb;
 
     bits  = estimate_dcs(error, td->blocks[plane], blocks_per_slice, qmat[0]);
-    bits += estimate_acs(error, td->blocks[plane], blocks_per_slice, ctx->scantable, qmat);
+    bits += estimate_acs(error, td->blocks[plane], blocks_per_slice,
+                         ctx->scantable, qmat, qrecip);
 
     return FFALIGN(bits, 8);
 }
@@ -789,6 +805,7 @@ static int find_slice_quant(AVCodecContext *avctx,
     int overquant;
     uint16_t *qmat;
     uint16_t *qmat_chroma;
+    uint32_t *qrecip, *qrecip_chroma;
     int linesize[4], line_add;
     int alpha_bits = 0;
 
@@ -844,13 +861,15 @@ static int find_slice_quant(AVCodecContext *avctx,
                                      src, linesize[0],
                                      mbs_per_slice,
                                      num_cblocks[0],
-                                     ctx->quants[q], td); /* estimate luma plane */
+                                     ctx->quants[q], ctx->quants_recip[q],
+                                     td); /* estimate luma plane */
         for (i = 1; i < ctx->num_planes - !!ctx->alpha_bits; i++) { /* estimate chroma plane */
             bits += estimate_slice_plane(ctx, &error, i,
                                          src, linesize[i],
                                          mbs_per_slice,
                                          num_cblocks[i],
-                                         ctx->quants_chroma[q], td);
+                                         ctx->quants_chroma[q],
+                                         ctx->quants_chroma_recip[q], td);
         }
         if (bits > 65000 * 8)
             error = SCORE_LIMIT;
@@ -869,25 +888,31 @@ static int find_slice_quant(AVCodecContext *avctx,
             if (q < MAX_STORED_Q) {
                 qmat = ctx->quants[q];
                 qmat_chroma = ctx->quants_chroma[q];
+                qrecip = ctx->quants_recip[q];
+                qrecip_chroma = ctx->quants_chroma_recip[q];
             } else {
                 qmat = td->custom_q;
                 qmat_chroma = td->custom_chroma_q;
+                qrecip = td->custom_q_recip;
+                qrecip_chroma = td->custom_chroma_q_recip;
                 for (i = 0; i < 64; i++) {
                     qmat[i] = ctx->quant_mat[i] * q;
                     qmat_chroma[i] = ctx->quant_chroma_mat[i] * q;
+                    qrecip[i] = QUANT_RECIP(qmat[i]);
+                    qrecip_chroma[i] = QUANT_RECIP(qmat_chroma[i]);
                 }
             }
             bits += estimate_slice_plane(ctx, &error, 0,
                                          src, linesize[0],
                                          mbs_per_slice,
                                          num_cblocks[0],
-                                         qmat, td);/* estimate luma plane */
+                                         qmat, qrecip, td);/* estimate luma plane */
             for (i = 1; i < ctx->num_planes - !!ctx->alpha_bits; i++) { /* estimate chroma plane */
                 bits += estimate_slice_plane(ctx, &error, i,
                                              src, linesize[i],
                                              mbs_per_slice,
                                              num_cblocks[i],
-                                             qmat_chroma, td);
+                                             qmat_chroma, qrecip_chroma, td);
             }
             if (bits <= ctx->bits_per_mb * mbs_per_slice)
                 break;
@@ -1246,6 +1271,8 @@ static av_cold int encode_init(AVCodecContext *avctx)
             for (j = 0; j < 64; j++) {
                 ctx->quants[i][j] = ctx->quant_mat[j] * i;
                 ctx->quants_chroma[i][j] = ctx->quant_chroma_mat[j] * i;
+                ctx->quants_recip[i][j] = QUANT_RECIP(ctx->quants[i][j]);
+                ctx->quants_chroma_recip[i][j] = QUANT_RECIP(ctx->quants_chroma[i][j]);
             }
         }
 
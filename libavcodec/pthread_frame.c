@@ -138,6 +138,9 @@ typedef struct FrameThreadContext {
                                     * While it is set, ff_thread_en/decode_frame won't return any results.
                                     */
 
+    int early_output;              ///< Set if AV_CODEC_FLAG2_EARLY_OUTPUT was set on init.
+    int nb_in_flight;              ///< Number of submitted packets whose output was not returned yet, early_output only.
+
     /* hwaccel state for thread-unsafe hwaccels is temporarily stored here in
      * order to transfer its ownership to the next decoding thread without the
      * need for extra synchronization */
@@ -489,6 +492,93 @@ static int submit_packet(PerThreadContext *p, AVCodecContext *user_avctx,
     return 0;
 }
 
+/**
+ * Wait for p to finish decoding and move its output to picture.
+ */
+static int collect_output(PerThreadContext *p, AVFrame *picture, int *got_picture_ptr)
+{
+    int err;
+
+    if (atomic_load(&p->state) != STATE_INPUT_READY) {
+        pthread_mutex_lock(&p->progress_mutex);
+        while (atomic_load_explicit(&p->state, memory_order_relaxed) != STATE_INPUT_READY)
+            pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+
+    av_frame_move_ref(picture, p->frame);
+    *got_picture_ptr = p->got_frame;
+    picture->pkt_dts = p->avpkt->dts;
+    err = p->result;
+
+    /*
+     * A later call with avkpt->size == 0 may loop over all threads,
+     * including this one, searching for a frame/error to return before being
+     * stopped by the "finished != fctx->next_finished" condition.
+     * Make sure we don't mistakenly return the same frame/error again.
+     */
+    p->got_frame = 0;
+    p->result = 0;
+
+    return err;
+}
+
+/*
+ * Variant of the output logic for AV_CODEC_FLAG2_EARLY_OUTPUT: the threads
+ * are used as a ring of in-flight packets, a frame is returned as soon as the
+ * oldest thread has finished, and we only wait for it when there is no free
+ * thread left for the next packet or when draining.
+ *
+ * An empty packet outside of draining does not submit anything, it only
+ * returns a frame if one is already finished.
+ */
+static int decode_frame_early_output(AVCodecContext *avctx,
+                                     AVFrame *picture, int *got_picture_ptr,
+                                     AVPacket *avpkt)
+{
+    FrameThreadContext *fctx = avctx->internal->thread_ctx;
+    const int poll = !avpkt->size && !avctx->internal->draining;
+    // as with the delay in ff_thread_decode_frame(), FFV1 keeps one thread
+    // spare, since a thread reads the context of the one before it
+    const int max_in_flight = avctx->thread_count - (avctx->codec_id == AV_CODEC_ID_FFV1);
+    PerThreadContext *p;
+    int err = 0;
+
+    *got_picture_ptr = 0;
+
+    if (!poll) {
+        int next_decoding = fctx->next_decoding;
+
+        err = submit_packet(&fctx->threads[next_decoding], avctx, avpkt);
+        if (err)
+            return err;
+
+        if (fctx->next_decoding != next_decoding) {
+            fctx->nb_in_flight++;
+            if (fctx->next_decoding >= avctx->thread_count)
+                fctx->next_decoding = 0;
+        }
+    }
+
+    while (fctx->nb_in_flight && !*got_picture_ptr && err >= 0) {
+        p = &fctx->threads[fctx->next_finished];
+
+        if (atomic_load(&p->state) != STATE_INPUT_READY &&
+            (poll || (avpkt->size && fctx->nb_in_flight < max_in_flight)))
+            break;
+
+        err = collect_output(p, picture, got_picture_ptr);
+        update_context_from_thread(avctx, p->avctx, 1);
+
+        fctx->nb_in_flight--;
+        if (++fctx->next_finished >= avctx->thread_count)
+            fctx->next_finished = 0;
+    }
+
+    /* return the size of the consumed packet if no error occurred */
+    return err < 0 ? err : avpkt->size;
+}
+
 int ff_thread_decode_frame(AVCodecContext *avctx,
                            AVFrame *picture, int *got_picture_ptr,
                            AVPacket *avpkt)
@@ -502,6 +592,11 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
      * go forward while we are in this function */
     async_unlock(fctx);
 
+    if (fctx->early_output) {
+        err = decode_frame_early_output(avctx, picture, got_picture_ptr, avpkt);
+        goto finish;
+    }
+
     /*
      * Submit a packet to the next decoding thread.
      */
@@ -536,26 +631,7 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
     do {
         p = &fctx->threads[finished++];
 
-        if (atomic_load(&p->state) != STATE_INPUT_READY) {
-            pthread_mutex_lock(&p->progress_mutex);
-            while (atomic_load_explicit(&p->state, memory_order_relaxed) != STATE_INPUT_READY)
-                pthread_cond_wait(&p->output_cond, &p->progress_mutex);
-            pthread_mutex_unlock(&p->progress_mutex);
-        }
-
-        av_frame_move_ref(picture, p->frame);
-        *got_picture_ptr = p->got_frame;
-        picture->pkt_dts = p->avpkt->dts;
-        err = p->result;
-
-        /*
-         * A later call with avkpt->size == 0 may loop over all threads,
-         * including this one, searching for a frame/error to return before being
-         * stopped by the "finished != fctx->next_finished" condition.
-         * Make sure we don't mistakenly return the same frame/error again.
-         */
-        p->got_frame = 0;
-        p->result = 0;
+        err = collect_output(p, picture, got_picture_ptr);
 
         if (finished >= avctx->thread_count) finished = 0;
     } while (!avpkt->size && !*got_picture_ptr && err >= 0 && finished != fctx->next_finished);
@@ -893,7 +969,10 @@ int ff_frame_thread_init(AVCodecContext *avctx)
 
     fctx->async_lock = 1;
     fctx->delaying = 1;
+    fctx->early_output = !!(avctx->flags2 & AV_CODEC_FLAG2_EARLY_OUTPUT);
 
+    /* Early output may still hold up to thread_count - 1 frames back when
+     * decoding is slower than the input. */
     if (codec->p.type == AVMEDIA_TYPE_VIDEO)
         avctx->delay = avctx->thread_count - 1;
 
@@ -933,6 +1012,7 @@ void ff_thread_flush(AVCodecContext *avctx)
     }
 
     fctx->next_decoding = fctx->next_finished = 0;
+    fctx->nb_in_flight = 0;
     fctx->delaying = 1;
     fctx->prev_thread = NULL;
     for (i = 0; i < avctx->thread_count; i++) {
@@ -947,6 +1027,12 @@ void ff_thread_flush(AVCodecContext *avctx)
     }
 }
 
+int ff_thread_early_output(AVCodecContext *avctx)
+{
+    const FrameThreadContext *fctx = avctx->internal->thread_ctx;
+    return fctx->early_output;
+}
+
 int ff_thread_can_start_frame(AVCodecContext *avctx)
 {
     if ((avctx->active_thread_type & FF_THREAD_FRAME) &&
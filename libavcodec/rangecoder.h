@@ -61,8 +61,8 @@ void ff_build_rac_states(RangeCoder *c, int factor, int max_p);
 
 static inline void renorm_encoder(RangeCoder *c)
 {
-    // FIXME: optimize
-    while (c->range < 0x100) {
+    /* range is at least 1 after coding a bit, so one byte is enough */
+    if (c->range < 0x100) {
         if (c->outstanding_byte < 0) {
             c->outstanding_byte = c->low >> 8;
         } else if (c->low <= 0xFF00) {
@@ -95,18 +95,15 @@ static inline int get_rac_count(RangeCoder *c)
 static inline void put_rac(RangeCoder *c, uint8_t *const state, int bit)
 {
     int range1 = (c->range * (*state)) >> 8;
+    int range0 = c->range - range1;
+    int mask   = -(bit != 0);
 
     av_assert2(*state);
     av_assert2(range1 < c->range);
     av_assert2(range1 > 0);
-    if (!bit) {
-        c->range -= range1;
-        *state    = c->zero_state[*state];
-    } else {
-        c->low  += c->range - range1;
-        c->range = range1;
-        *state   = c->one_state[*state];
-    }
+    c->low  += range0 & mask;
+    c->range = range0 + ((range1 - range0) & mask);
+    *state   = (bit ? c->one_state : c->zero_state)[*state];
 
     renorm_encoder(c);
 }
@@ -127,19 +124,17 @@ static inline void refill(RangeCoder *c)
 static inline int get_rac(RangeCoder *c, uint8_t *const state)
 {
     int range1 = (c->range * (*state)) >> 8;
+    int bit, mask;
 
+    /* The decoded bits are hard to predict, so avoid branching on them. */
     c->range -= range1;
-    if (c->low < c->range) {
-        *state = c->zero_state[*state];
-        refill(c);
-        return 0;
-    } else {
-        c->low  -= c->range;
-        *state   = c->one_state[*state];
-        c->range = range1;
-        refill(c);
-        return 1;
-    }
+    bit  = c->low >= c->range;
+    mask = -bit;
+    c->low   -= c->range & mask;
+    c->range += (range1 - c->range) & mask;
+    *state    = (bit ? c->one_state : c->zero_state)[*state];
+    refill(c);
+    return bit;
 }
 
 #endif /* AVCODEC_RANGECODER_H */
@@ -890,6 +890,56 @@ void ff_get_2pass_fcode(MpegEncContext *s)
     s->b_code = rce->b_code;
 }
 
+/**
+ * Restart the bit budget at the next picture, which begins a closed GOP
+ * that is coded independently of the preceding ones. Those are assumed to
+ * have used exactly their budget of bit_rate bits per second, unless
+ * ff_rate_control_copy_state() is called afterwards. The predictors and
+ * statistics are kept.
+ */
+void ff_rate_control_restart(MpegEncContext *s)
+{
+    s->total_bits            = 0;
+    s->rc_context.pts_offset = AV_NOPTS_VALUE;
+}
+
+/**
+ * Continue the 1-pass rate control of src in dst, which has just been
+ * restarted: copy the size predictors, the statistics and the last
+ * quantisers, and carry over by how many bits src has deviated from its
+ * budget since its own restart, as the quantiser depends on that.
+ */
+void ff_rate_control_copy_state(MpegEncContext *d, const MpegEncContext *s)
+{
+    RateControlContext *dst = &d->rc_context;
+    const RateControlContext *src = &s->rc_context;
+
+    memcpy(dst->pred,            src->pred,            sizeof(dst->pred));
+    memcpy(dst->last_qscale_for, src->last_qscale_for, sizeof(dst->last_qscale_for));
+    memcpy(dst->i_cplx_sum,      src->i_cplx_sum,      sizeof(dst->i_cplx_sum));
+    memcpy(dst->p_cplx_sum,      src->p_cplx_sum,      sizeof(dst->p_cplx_sum));
+    memcpy(dst->mv_bits_sum,     src->mv_bits_sum,     sizeof(dst->mv_bits_sum));
+    memcpy(dst->qscale_sum,      src->qscale_sum,      sizeof(dst->qscale_sum));
+    memcpy(dst->frame_count,     src->frame_count,     sizeof(dst->frame_count));
+
+    dst->short_term_qsum        = src->short_term_qsum;
+    dst->short_term_qcount      = src->short_term_qcount;
+    dst->pass1_rc_eq_output_sum = src->pass1_rc_eq_output_sum;
+    dst->pass1_wanted_bits      = src->pass1_wanted_bits;
+    dst->last_qscale            = src->last_qscale;
+    dst->last_mc_mb_var_sum     = src->last_mc_mb_var_sum;
+    dst->last_mb_var_sum        = src->last_mb_var_sum;
+    dst->last_non_b_pict_type   = src->last_non_b_pict_type;
+
+    memcpy(d->last_lambda_for, s->last_lambda_for, sizeof(d->last_lambda_for));
+    d->last_pict_type       = s->last_pict_type;
+    d->last_non_b_pict_type = s->last_non_b_pict_type;
+
+    d->total_bits = s->total_bits -
+                    (int64_t)(s->bit_rate * (double)s->input_picture_number /
+                              get_fps(s->avctx));
+}
+
 // FIXME rd or at least approx for dquant
 
 float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
@@ -946,10 +996,16 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
         else
             dts_pic = s->last_pic.ptr;
 
+        if (rcc->pts_offset == AV_NOPTS_VALUE) {
+            rcc->pts_offset = s->cur_pic.ptr->f->pts;
+            if (rcc->pts_offset == AV_NOPTS_VALUE)
+                rcc->pts_offset = 0;
+        }
+
         if (!dts_pic || dts_pic->f->pts == AV_NOPTS_VALUE)
             wanted_bits = (uint64_t)(s->bit_rate * (double)picture_number / fps);
         else
-            wanted_bits = (uint64_t)(s->bit_rate * (double)dts_pic->f->pts / fps);
+            wanted_bits = (uint64_t)(s->bit_rate * (double)(dts_pic->f->pts - rcc->pts_offset) / fps);
     }
 
     diff = s->total_bits - wanted_bits;
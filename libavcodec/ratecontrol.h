@@ -76,6 +76,7 @@ typedef struct RateControlContext{
     uint64_t qscale_sum[5];
     int frame_count[5];
     int last_non_b_pict_type;
+    int64_t pts_offset;           ///< pts at which the bit budget starts, AV_NOPTS_VALUE: at the next picture
 
     struct AVExpr *rc_eq_eval;
 }RateControlContext;
@@ -89,5 +90,8 @@ void ff_write_pass1_stats(struct MpegEncContext *s);
 int ff_vbv_update(struct MpegEncContext *s, int frame_size);
 void ff_get_2pass_fcode(struct MpegEncContext *s);
 void ff_rate_control_uninit(RateControlContext *rcc);
+void ff_rate_control_restart(struct MpegEncContext *s);
+void ff_rate_control_copy_state(struct MpegEncContext *dst,
+                                const struct MpegEncContext *src);
 
 #endif /* AVCODEC_RATECONTROL_H */
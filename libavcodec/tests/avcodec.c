@@ -135,6 +135,9 @@ int main(void){
                 ERR("Encoder %s is both subtitle encoder and not subtitle encoder.");
             if (codec2->update_thread_context || codec2->update_thread_context_for_user || codec2->bsfs)
                 ERR("Encoder %s has decoder-only thread functions or bsf.\n");
+            if (codec2->update_gop_state &&
+                !(codec2->caps_internal & FF_CODEC_CAP_GOP_THREADS))
+                ERR("Encoder %s has update_gop_state without GOP threading\n");
             if (codec->type == AVMEDIA_TYPE_AUDIO) {
                 if (!codec->sample_fmts) {
                     av_log(NULL, AV_LOG_FATAL, "Encoder %s is missing the sample_fmts field\n", codec->name);
@@ -171,6 +174,9 @@ int main(void){
                                        AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE |
                                        AV_CODEC_CAP_ENCODER_FLUSH))
                 ERR("Decoder %s has encoder-only capabilities\n");
+            if (codec2->update_gop_state ||
+                codec2->caps_internal & FF_CODEC_CAP_GOP_THREADS)
+                ERR("Decoder %s has encoder-only GOP threading\n");
             if (codec2->cb_type != FF_CODEC_CB_TYPE_DECODE &&
                 codec2->caps_internal & FF_CODEC_CAP_SETS_PKT_DTS)
                 ERR("Decoder %s is marked as setting pkt_dts when it doesn't have"
@@ -54,6 +54,14 @@ int ff_thread_decode_frame(AVCodecContext *avctx, AVFrame *picture,
 
 int ff_thread_can_start_frame(AVCodecContext *avctx);
 
+/**
+ * Check whether frame threading was initialized with
+ * AV_CODEC_FLAG2_EARLY_OUTPUT, in which case ff_thread_decode_frame() may
+ * return finished frames when called without new input.
+ * Must only be called on the user-facing context with frame threading active.
+ */
+int ff_thread_early_output(AVCodecContext *avctx);
+
 /**
  * If the codec defines update_thread_context(), call this
  * when they are ready for the next thread to start decoding
@@ -72,6 +72,11 @@ void ff_inflate_end(FFZStream *z)
 
 #if CONFIG_DEFLATE_WRAPPER
 int ff_deflate_init(FFZStream *z, int level, void *logctx)
+{
+    return ff_deflate_init2(z, level, MAX_WBITS, logctx);
+}
+
+int ff_deflate_init2(FFZStream *z, int level, int window_bits, void *logctx)
 {
     z_stream *const zstream = &z->zstream;
     int zret;
@@ -81,7 +86,9 @@ int ff_deflate_init(FFZStream *z, int level, void *logctx)
     zstream->zfree  = free_wrapper;
     zstream->opaque = Z_NULL;
 
-    zret = deflateInit(zstream, level);
+    /* 8 is the default memory level used by deflateInit() */
+    zret = deflateInit2(zstream, level, Z_DEFLATED, window_bits,
+                        8, Z_DEFAULT_STRATEGY);
     if (zret == Z_OK) {
         z->inited = 1;
     } else {
@@ -0,0 +1,230 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * fftools thread queue test
+ *
+ * Passes a sequence of numbers between two threads, with one side pausing
+ * regularly so that the other one has to sleep on an empty or full queue,
+ * and checks that every item arrives in order and that finishing either side
+ * wakes up the other one. A lost wakeup makes the test hang.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h" // not public
+#include "libavutil/time.h"
+
+#include "fftools/objpool.h"
+#include "fftools/thread_queue.h"
+
+typedef struct TestContext {
+    ThreadQueue *tq;
+    int          nb_items;
+    // stop receiving after this many items, -1 to receive until EOF
+    int          recv_items;
+    // pause for a moment every pause_period items on this side
+    int          pause_send;
+    int          pause_recv;
+    int          pause_period;
+
+    int          nb_sent;
+    int          send_ret;
+    int          nb_received;
+    int          recv_ret;
+} TestContext;
+
+static void *item_alloc(void)
+{
+    return av_mallocz(sizeof(int64_t));
+}
+
+static void item_reset(void *obj)
+{
+    memset(obj, 0, sizeof(int64_t));
+}
+
+static void item_free(void **obj)
+{
+    av_freep(obj);
+}
+
+static void item_move(void *dst, void *src)
+{
+    memcpy(dst, src, sizeof(int64_t));
+    item_reset(src);
+}
+
+static void *sender_thread(void *arg)
+{
+    TestContext *tc = arg;
+
+    for (int i = 0; i < tc->nb_items; i++) {
+        int64_t val = i + 1;
+
+        if (tc->pause_send && !(i % tc->pause_period))
+            av_usleep(100);
+
+        tc->send_ret = tq_send(tc->tq, 0, &val);
+        if (tc->send_ret < 0)
+            break;
+        tc->nb_sent++;
+    }
+
+    tq_send_finish(tc->tq, 0);
+
+    return NULL;
+}
+
+static void *receiver_thread(void *arg)
+{
+    TestContext *tc = arg;
+
+    while (tc->recv_items < 0 || tc->nb_received < tc->recv_items) {
+        int64_t val;
+        int stream_idx;
+
+        if (tc->pause_recv && !(tc->nb_received % tc->pause_period))
+            av_usleep(100);
+
+        tc->recv_ret = tq_receive(tc->tq, &stream_idx, &val);
+        if (tc->recv_ret < 0)
+            break;
+
+        if (stream_idx != 0 || val != tc->nb_received + 1) {
+            av_log(NULL, AV_LOG_ERROR, "received item %"PRId64" on stream %d, "
+                   "expected %d on stream 0\n", val, stream_idx,
+                   tc->nb_received + 1);
+            tc->recv_ret = AVERROR_BUG;
+            break;
+        }
+        tc->nb_received++;
+    }
+
+    tq_receive_finish(tc->tq, 0);
+
+    return NULL;
+}
+
+static int run_test(const char *name, unsigned flags, size_t queue_size,
+                    int nb_items, int recv_items,
+                    int pause_send, int pause_recv, int pause_period)
+{
+    TestContext tc = {
+        .nb_items     = nb_items,
+        .recv_items   = recv_items,
+        .pause_send   = pause_send,
+        .pause_recv   = pause_recv,
+        .pause_period = pause_period,
+    };
+    pthread_t sender, receiver;
+    ObjPool *op;
+    int ret;
+
+    op = objpool_alloc(item_alloc, item_reset, item_free);
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    tc.tq = tq_alloc(1, queue_size, op, item_move, flags);
+    if (!tc.tq) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_create(&sender, NULL, sender_thread, &tc);
+    if (ret) {
+        tq_free(&tc.tq);
+        return AVERROR(ret);
+    }
+    ret = pthread_create(&receiver, NULL, receiver_thread, &tc);
+    if (ret) {
+        tq_receive_finish(tc.tq, 0);
+        pthread_join(sender, NULL);
+        tq_free(&tc.tq);
+        return AVERROR(ret);
+    }
+
+    pthread_join(sender,   NULL);
+    pthread_join(receiver, NULL);
+
+    tq_free(&tc.tq);
+
+    if (tc.recv_ret == AVERROR_BUG)
+        return tc.recv_ret;
+
+    // with an early receiver finish, the number of items the sender got
+    // through before seeing EOF depends on the timing
+    if (recv_items >= 0) {
+        printf("%s: received %d, sender %s\n", name, tc.nb_received,
+               tc.send_ret == AVERROR_EOF ? "got EOF" : "did not get EOF");
+        return tc.nb_received == recv_items && tc.send_ret == AVERROR_EOF ?
+               0 : AVERROR_BUG;
+    }
+
+    printf("%s: sent %d, received %d, receiver %s\n", name,
+           tc.nb_sent, tc.nb_received,
+           tc.recv_ret == AVERROR_EOF ? "got EOF" : "did not get EOF");
+    return tc.nb_sent == nb_items && tc.nb_received == nb_items &&
+           tc.recv_ret == AVERROR_EOF ? 0 : AVERROR_BUG;
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        unsigned    flags;
+    } modes[] = {
+        { "spsc",   THREAD_QUEUE_FLAG_SPSC },
+        { "locked", 0 },
+    };
+    int ret = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(modes); i++) {
+        char name[64];
+
+#define RUN(desc, ...)                                                      \
+        do {                                                                \
+            int err;                                                        \
+            snprintf(name, sizeof(name), "%s %s", modes[i].name, desc);     \
+            err = run_test(name, modes[i].flags, __VA_ARGS__);              \
+            if (err < 0) {                                                  \
+                av_log(NULL, AV_LOG_ERROR, "%s failed: %s\n",               \
+                       name, av_err2str(err));                              \
+                ret = 1;                                                    \
+            }                                                               \
+        } while (0)
+
+        // every send and receive may have to wait for the other side
+        RUN("size 1",         1, 10000, -1, 0, 0, 1);
+        // the receiver keeps emptying the queue and sleeping on it
+        RUN("slow sender",    8,  2000, -1, 1, 0, 16);
+        // the sender keeps filling the queue and sleeping on it
+        RUN("slow receiver",  8,  2000, -1, 0, 1, 16);
+        // the receiver stops while the sender is sleeping on a full queue
+        RUN("receiver stops", 4,  2000, 100, 0, 1, 16);
+#undef RUN
+    }
+
+    return ret;
+}
@@ -440,6 +440,44 @@ static void check_loop_filter_intra(void)
     }
 }
 
+static void check_startcode(void)
+{
+    LOCAL_ALIGNED_16(uint8_t, buf, [1024 + 64]);
+    H264DSPContext h;
+    int res0, res1;
+
+    declare_func(int, const uint8_t *buf, int size);
+
+    ff_h264dsp_init(&h, 8, 1);
+
+    if (check_func(h.startcode_find_candidate, "startcode_find_candidate")) {
+        for (int i = 0; i < 1024 + 64; i++)
+            buf[i] = rnd() | 1;
+
+        for (int i = 0; i < 64; i++) {
+            // cover all sizes and alignments, with or without a zero byte
+            int off  = rnd() & 15;
+            int size = rnd() % (1024 - off);
+            int pos  = rnd() % (size + 1);
+            int zero = buf[off + pos];
+
+            buf[off + pos] = 0;
+            res0 = call_ref(buf + off, size);
+            res1 = call_new(buf + off, size);
+            if (res0 != res1)
+                fail();
+            buf[off + pos] = zero;
+        }
+
+        // no zero byte at all
+        res0 = call_ref(buf, 1024);
+        res1 = call_new(buf, 1024);
+        if (res0 != res1)
+            fail();
+        bench_new(buf, 1024);
+    }
+}
+
 void checkasm_check_h264dsp(void)
 {
     check_idct();
@@ -451,4 +489,7 @@ void checkasm_check_h264dsp(void)
 
     check_loop_filter_intra();
     report("loop_filter_intra");
+
+    check_startcode();
+    report("startcode");
 }
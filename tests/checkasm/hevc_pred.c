@@ -0,0 +1,186 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/hevc/pred.h"
+
+#include "checkasm.h"
+
+#define MAX_SIZE     32
+// the prediction functions take the stride in pixels, not bytes
+#define PIXEL_STRIDE (MAX_SIZE * 2)
+#define BUF_SIZE     (PIXEL_STRIDE * MAX_SIZE)
+// the edge arrays are accessed from index -1 to 2 * size, with some overread
+#define EDGE_SIZE    (4 * MAX_SIZE + 8)
+#define EDGE_OFFSET  4
+
+#define SIZEOF_PIXEL ((bit_depth + 7) / 8)
+
+#define randomize_buffers(buf, size)                        \
+    do {                                                    \
+        int k;                                              \
+        for (k = 0; k < size; k++) {                        \
+            unsigned r = rnd() & ((1 << bit_depth) - 1);    \
+            if (bit_depth == 8)                             \
+                buf[k] = r;                                 \
+            else                                            \
+                AV_WN16A(buf + 2 * k, r);                   \
+        }                                                   \
+    } while (0)
+
+static void check_pred_planar(HEVCPredContext *h, uint8_t *dst0, uint8_t *dst1,
+                              uint8_t *top, uint8_t *left, int bit_depth)
+{
+    const ptrdiff_t stride = PIXEL_STRIDE;
+
+    declare_func(void, uint8_t *src, const uint8_t *top,
+                 const uint8_t *left, ptrdiff_t stride);
+
+    for (int i = 0; i < 4; i++) {
+        int size = 1 << (i + 2);
+
+        if (check_func(h->pred_planar[i], "hevc_pred_planar_%dx%d_%d",
+                       size, size, bit_depth)) {
+            memset(dst0, 0, BUF_SIZE * SIZEOF_PIXEL);
+            memset(dst1, 0, BUF_SIZE * SIZEOF_PIXEL);
+
+            call_ref(dst0, top, left, stride);
+            call_new(dst1, top, left, stride);
+            if (memcmp(dst0, dst1, BUF_SIZE * SIZEOF_PIXEL))
+                fail();
+            bench_new(dst1, top, left, stride);
+        }
+    }
+}
+
+static void check_pred_dc(HEVCPredContext *h, uint8_t *dst0, uint8_t *dst1,
+                          uint8_t *top, uint8_t *left, int bit_depth)
+{
+    const ptrdiff_t stride = PIXEL_STRIDE;
+
+    declare_func(void, uint8_t *src, const uint8_t *top,
+                 const uint8_t *left, ptrdiff_t stride, int log2_size, int c_idx);
+
+    for (int log2_size = 2; log2_size <= 5; log2_size++) {
+        int size = 1 << log2_size;
+
+        if (check_func(h->pred_dc, "hevc_pred_dc_%dx%d_%d",
+                       size, size, bit_depth)) {
+            for (int c_idx = 0; c_idx <= 1; c_idx++) {
+                memset(dst0, 0, BUF_SIZE * SIZEOF_PIXEL);
+                memset(dst1, 0, BUF_SIZE * SIZEOF_PIXEL);
+
+                call_ref(dst0, top, left, stride, log2_size, c_idx);
+                call_new(dst1, top, left, stride, log2_size, c_idx);
+                if (memcmp(dst0, dst1, BUF_SIZE * SIZEOF_PIXEL))
+                    fail();
+            }
+            bench_new(dst1, top, left, stride, log2_size, 0);
+        }
+    }
+}
+
+static void check_pred_angular(HEVCPredContext *h, uint8_t *dst0, uint8_t *dst1,
+                               uint8_t *top, uint8_t *left, int bit_depth)
+{
+    const ptrdiff_t stride = PIXEL_STRIDE;
+
+    declare_func(void, uint8_t *src, const uint8_t *top,
+                 const uint8_t *left, ptrdiff_t stride, int c_idx, int mode);
+
+    for (int i = 0; i < 4; i++) {
+        int size = 1 << (i + 2);
+
+        // modes 2-34, 0 and 1 are planar and DC
+        for (int mode = 2; mode <= 34; mode++) {
+            if (check_func(h->pred_angular[i], "hevc_pred_angular_%d_%dx%d_%d",
+                           mode, size, size, bit_depth)) {
+                // the edge filters for the pure horizontal and vertical modes
+                // are only applied to luma
+                for (int c_idx = 0; c_idx <= 1; c_idx++) {
+                    memset(dst0, 0, BUF_SIZE * SIZEOF_PIXEL);
+                    memset(dst1, 0, BUF_SIZE * SIZEOF_PIXEL);
+
+                    call_ref(dst0, top, left, stride, c_idx, mode);
+                    call_new(dst1, top, left, stride, c_idx, mode);
+                    if (memcmp(dst0, dst1, BUF_SIZE * SIZEOF_PIXEL))
+                        fail();
+                }
+                bench_new(dst1, top, left, stride, 0, mode);
+            }
+        }
+    }
+}
+
+void checkasm_check_hevc_pred(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, dst0,     [BUF_SIZE * 2]);
+    LOCAL_ALIGNED_32(uint8_t, dst1,     [BUF_SIZE * 2]);
+    LOCAL_ALIGNED_32(uint8_t, top_buf,  [EDGE_SIZE * 2]);
+    LOCAL_ALIGNED_32(uint8_t, left_buf, [EDGE_SIZE * 2]);
+    static const int bit_depths[] = { 8, 9, 10, 12 };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bit_depths); i++) {
+        const int bit_depth = bit_depths[i];
+        uint8_t *top  = top_buf  + EDGE_OFFSET * SIZEOF_PIXEL;
+        uint8_t *left = left_buf + EDGE_OFFSET * SIZEOF_PIXEL;
+        HEVCPredContext h;
+
+        ff_hevc_pred_init(&h, bit_depth);
+
+        randomize_buffers(top_buf,  EDGE_SIZE);
+        randomize_buffers(left_buf, EDGE_SIZE);
+
+        check_pred_planar(&h, dst0, dst1, top, left, bit_depth);
+    }
+    report("pred_planar");
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bit_depths); i++) {
+        const int bit_depth = bit_depths[i];
+        uint8_t *top  = top_buf  + EDGE_OFFSET * SIZEOF_PIXEL;
+        uint8_t *left = left_buf + EDGE_OFFSET * SIZEOF_PIXEL;
+        HEVCPredContext h;
+
+        ff_hevc_pred_init(&h, bit_depth);
+
+        randomize_buffers(top_buf,  EDGE_SIZE);
+        randomize_buffers(left_buf, EDGE_SIZE);
+
+        check_pred_dc(&h, dst0, dst1, top, left, bit_depth);
+    }
+    report("pred_dc");
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bit_depths); i++) {
+        const int bit_depth = bit_depths[i];
+        uint8_t *top  = top_buf  + EDGE_OFFSET * SIZEOF_PIXEL;
+        uint8_t *left = left_buf + EDGE_OFFSET * SIZEOF_PIXEL;
+        HEVCPredContext h;
+
+        ff_hevc_pred_init(&h, bit_depth);
+
+        randomize_buffers(top_buf,  EDGE_SIZE);
+        randomize_buffers(left_buf, EDGE_SIZE);
+
+        check_pred_angular(&h, dst0, dst1, top, left, bit_depth);
+    }
+    report("pred_angular");
+}
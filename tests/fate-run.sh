@@ -180,6 +180,17 @@ md5(){
     do_md5sum $encfile | awk '{print $1}'
 }
 
+# Encode twice and check that both runs produce the same output.
+md5_repeat(){
+    encfile="${outdir}/${test}.out"
+    encfile2="${outdir}/${test}.2.out"
+    cleanfiles="$cleanfiles $encfile $encfile2"
+    ffmpeg -y "$@" $(target_path $encfile)  || return
+    ffmpeg -y "$@" $(target_path $encfile2) || return
+    cmp -s $encfile $encfile2 || { echo "$encfile and $encfile2 differ" >&2; return 1; }
+    do_md5sum $encfile | awk '{print $1}'
+}
+
 pcm(){
     ffmpeg -auto_conversion_filters "$@" -vn -f s16le -
 }
@@ -247,6 +258,30 @@ enc_dec(){
         run ffprobe${PROGSUF}${EXECSUF} -bitexact $ffprobe_opts $tencfile || return
 }
 
+# Encode, then decode twice, with and without the given decoder options, and
+# check that both decodes output the same frames.
+enc_framemd5_cmp(){
+    enc_fmt_in=$1
+    srcfile=$2
+    enc_fmt_out=$3
+    enc_opt_out=$4
+    dec_opt_cmp=$5
+    encfile="${outdir}/${test}.${enc_fmt_out}"
+    decfile="${outdir}/${test}.framemd5"
+    decfile2="${outdir}/${test}.cmp.framemd5"
+    cleanfiles="$cleanfiles $encfile $decfile $decfile2"
+    tsrcfile=$(target_path $srcfile)
+    tencfile=$(target_path $encfile)
+
+    ffmpeg -f $enc_fmt_in $DEC_OPTS -i $tsrcfile $ENC_OPTS $enc_opt_out $FLAGS \
+        -f $enc_fmt_out -y $tencfile || return
+    ffmpeg $DEC_OPTS -i $tencfile $FLAGS -f framemd5 -y $(target_path $decfile) || return
+    ffmpeg $dec_opt_cmp $DEC_OPTS -i $tencfile $FLAGS \
+        -f framemd5 -y $(target_path $decfile2) || return
+    cmp -s $decfile $decfile2 || { echo "$decfile and $decfile2 differ" >&2; return 1; }
+    cat $decfile
+}
+
 transcode(){
     src_fmt=$1
     srcfile=$2
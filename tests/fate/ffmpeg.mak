@@ -23,6 +23,39 @@ fate-force_key_frames: CMD = enc_dec \
   avi "-c mpeg4 -g 240 -qscale 10 -force_key_frames 0.5,0:00:01.5" \
   framecrc "" "-skip_frame nokey"
 
+# Closed GOPs coded in parallel must give the same output on every run.
+FATE_FFMPEG_GOP_THREADS-$(call DEMDEC, RAWVIDEO, RAWVIDEO, MPEG2VIDEO_ENCODER MPEG2VIDEO_MUXER) += fate-ffmpeg-gop_threads-mpeg2
+fate-ffmpeg-gop_threads-mpeg2: CMD = md5_repeat -f rawvideo -s 352x288 -pix_fmt yuv420p \
+  -i $(TARGET_PATH)/tests/data/vsynth1.yuv -c:v mpeg2video -threads 3 -gop_threads 1 \
+  -flags +cgop+bitexact -g 6 -bf 2 -sc_threshold 1000000000 -b:v 800k -fflags +bitexact -f mpeg2video
+
+FATE_FFMPEG_GOP_THREADS-$(call DEMDEC, RAWVIDEO, RAWVIDEO, MPEG4_ENCODER M4V_MUXER) += fate-ffmpeg-gop_threads-mpeg4
+fate-ffmpeg-gop_threads-mpeg4: CMD = md5_repeat -f rawvideo -s 352x288 -pix_fmt yuv420p \
+  -i $(TARGET_PATH)/tests/data/vsynth1.yuv -c:v mpeg4 -threads 3 -gop_threads 1 \
+  -flags +cgop+bitexact -g 6 -bf 2 -sc_threshold 1000000000 -b:v 800k -fflags +bitexact -f m4v
+
+$(FATE_FFMPEG_GOP_THREADS-yes): tests/data/vsynth1.yuv
+FATE_FFMPEG-$(HAVE_THREADS) += $(FATE_FFMPEG_GOP_THREADS-yes)
+
+# Frame threading with early output must return the same frames as without.
+FATE_EARLY_OUTPUT_THREADS = 1 2 4 7
+
+define FATE_EARLY_OUTPUT
+FATE_EARLY_OUTPUT_$(1) = $(FATE_EARLY_OUTPUT_THREADS:%=fate-ffmpeg-early_output-$(1)-%)
+FATE_FFMPEG_EARLY_OUTPUT-$(call ENCDEC, $(2), AVI, FRAMEMD5_MUXER RAWVIDEO_DEMUXER) += $$(FATE_EARLY_OUTPUT_$(1))
+$$(FATE_EARLY_OUTPUT_$(1)): THREADS = $$(@:fate-ffmpeg-early_output-$(1)-%=%)
+$$(FATE_EARLY_OUTPUT_$(1)): THREAD_TYPE = frame
+$$(FATE_EARLY_OUTPUT_$(1)): REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-early_output-$(1)
+$$(FATE_EARLY_OUTPUT_$(1)): CMD = enc_framemd5_cmp \
+  "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv avi "$(3)" "-flags2 +early_output"
+endef
+
+$(eval $(call FATE_EARLY_OUTPUT,mpeg4,MPEG4,-c:v mpeg4 -qscale 10 -bf 2))
+$(eval $(call FATE_EARLY_OUTPUT,ffv1,FFV1,-c:v ffv1 -g 10))
+
+$(FATE_FFMPEG_EARLY_OUTPUT-yes): tests/data/vsynth1.yuv
+FATE_FFMPEG-$(HAVE_THREADS) += $(FATE_FFMPEG_EARLY_OUTPUT-yes)
+
 # test -force_key_frames source with and without framerate conversion
 # * we don't care about the actual video content, so replace it with
 #   a 2x2 black square to speed up encoding
@@ -43,6 +76,18 @@ fate-force_key_frames-source-dup: CMD = framecrc -i $(TARGET_SAMPLES)/h264/intra
 FATE_SAMPLES_FFMPEG-$(call ENCDEC, MPEG2VIDEO H264, FRAMECRC H264, CROP_FILTER DRAWBOX_FILTER) += \
     fate-force_key_frames-source fate-force_key_frames-source-drop fate-force_key_frames-source-dup
 
+# Test that a keyframe dropped for exceeding -latency_budget is replaced by the
+# next encoded frame. Frame 5 is held back for one second, so it and the frames
+# demuxed before it was released are dropped; the decoder then only outputs
+# the first frame and the frame forced to a keyframe after the dropped ones.
+FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR SETPTS REALTIME, LAVFI_INDEV MPEG2VIDEO_ENCODER MPEG2VIDEO_DECODER NULL_MUXER) += fate-ffmpeg-latency_budget-keyframe
+fate-ffmpeg-latency_budget-keyframe: CMD = framecrc \
+  -f lavfi -i "color=c=gray:s=32x32:r=25:d=2"                        \
+  -vf "setpts=eq(N\,5)/TB,realtime,setpts=N/(25*TB)"                 \
+  -map 0:v -c:v mpeg2video -g 1000 -latency_budget 0.5 -f null -     \
+  -skip_frame nokey -dec 0:0 -filter_complex "[dec:0]setpts=N[out]"   \
+  -map "[out]" -c:v rawvideo -fps_mode passthrough
+
 # Tests that the video is properly autorotated using the contained
 # display matrix and that the generated file does not contain
 # a display matrix any more.